@@ -17,6 +17,7 @@ pushd build
 
         SET files=..\..\src\win32\win32_main.cpp
         SET files=%files% ..\..\src\shared\app.cpp
+        SET files=%files% ..\..\src\shared\gtm.cpp
         SET files=%files% ..\..\src\shared\xmaths.cpp
 
         SET linkFlags=/incremental:no /opt:ref user32.lib Gdi32.lib opengl32.lib
@@ -15,21 +15,33 @@ cd build
 
 	cd linux
 
-		compileFlags="-Wall -fno-rtti -fno-exceptions -Wno-write-strings -Wno-unused-function -Wno-unused-result -no-pie -pipe -march=x86-64 -o linux_main"
+		compileFlags="-Wall -fno-rtti -fno-exceptions -Wno-write-strings -Wno-unused-function -Wno-unused-result -no-pie -pipe -march=x86-64"
 
 		debugCompileFlags="-O0 -g3 -D_DEBUG"
-		releaseCompileFlags="-O3 -g0 -flto -ffast-math -mavx2 -DNDEBUG"
+		releaseCompileFlags="-O3 -g0 -flto -ffast-math -mavx2 -mfma -DNDEBUG"
 		#releaseCompileFlags="$releaseCompileFlags -fopt-info-vec-optimized"
 
 		compileFlags="$debugCompileFlags $compileFlags"
 		#compileFlags="$releaseCompileFlags $compileFlags"
 
-		libs="-lstdc++ -lm -lX11 -lGL -lpthread"
+		libs="-lstdc++ -lm -lpthread"
+
+		sharedFiles="../../src/linux/linux_platform.cpp"
+		sharedFiles="$sharedFiles ../../src/shared/gtm.cpp"
+		sharedFiles="$sharedFiles ../../src/shared/xmaths.cpp"
 
 		files="../../src/linux/linux_main.cpp"
 		files="$files ../../src/shared/app.cpp"
-		files="$files ../../src/shared/xmaths.cpp"
+		files="$files $sharedFiles"
 
 		linkFlags="-Map=build.map -Wno-undef"
 
-		gcc $compileFlags $files $libs -Xlinker $linkFlags
\ No newline at end of file
+		gcc $compileFlags -o linux_main $files $libs -lX11 -lGL -Xlinker $linkFlags
+
+		#headless trainer, no X11/GL dependency
+		headlessFiles="../../src/linux/linux_headless_main.cpp"
+		headlessFiles="$headlessFiles $sharedFiles"
+
+		headlessLinkFlags="-Map=gtm_headless.map -Wno-undef"
+
+		gcc $compileFlags -o gtm_headless $headlessFiles $libs -Xlinker $headlessLinkFlags
\ No newline at end of file
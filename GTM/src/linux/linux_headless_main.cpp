@@ -0,0 +1,302 @@
+#include "../shared/gtm.h"
+#include "../shared/platform.h"
+#include "../shared/types.h"
+#include "../shared/utils.h"
+#include "linux_platform.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+namespace
+{
+    void PrintUsage()
+    {
+        LOG( "usage: gtm_headless <dataset> [options]\n" );
+        LOG( "    -b <count>        noBasisFunction per latent dimension\n" );
+        LOG( "    -l <count>        noLatVarSample per latent dimension\n" );
+        LOG( "    -s <value>        basis function width scale\n" );
+        LOG( "    -d <count>        latentDimensions\n" );
+        LOG( "    -o <directory>    directory to write the gtm and llh files to\n" );
+        LOG( "    -p <f64|f32>      precision of the e step, f64 by default\n" );
+        LOG( "    -e <tolerance>    prune the e step so each cycle's llh is at most tolerance below the exact llh of that\n" );
+        LOG( "                      cycle's output, 0 by default; training then follows its own path, so -c can differ by more\n" );
+        LOG( "    -c                train exact f64 first and report how far the llh of the chosen precision and pruning is from it\n" );
+        LOG( "    -a <none|cores|threads>\n" );
+        LOG( "                      pin a worker to every physical core or every hardware thread, none by default\n" );
+        LOG( "    -n <firsttouch|interleave>\n" );
+        LOG( "                      NUMA placement of large arrays, firsttouch by default\n" );
+        LOG( "    -t <count>        worker threads, by default GTM_THREAD_COUNT or the cpus the process may use\n" );
+        LOG( "parameters not given on the command line come from the dataset header\n" );
+    }
+
+    bool ParseAffinity( char* string, LinuxPlatform::Affinity* affinity )
+    {
+        if( strcmp( string, "none" ) == 0 )
+            *affinity = LinuxPlatform::Affinity_None;
+        else if( strcmp( string, "cores" ) == 0 )
+            *affinity = LinuxPlatform::Affinity_Cores;
+        else if( strcmp( string, "threads" ) == 0 )
+            *affinity = LinuxPlatform::Affinity_Threads;
+        else
+            return false;
+
+        return true;
+    }
+
+    bool ParseNumaPolicy( char* string, Platform::NumaPolicy* numaPolicy )
+    {
+        if( strcmp( string, "firsttouch" ) == 0 )
+            *numaPolicy = Platform::NumaPolicy_FirstTouch;
+        else if( strcmp( string, "interleave" ) == 0 )
+            *numaPolicy = Platform::NumaPolicy_Interleave;
+        else
+            return false;
+
+        return true;
+    }
+
+    bool ParsePrecision( char* string, GTM::Precision* precision )
+    {
+        if( strcmp( string, "f64" ) == 0 )
+            *precision = GTM::Precision_F64;
+        else if( strcmp( string, "f32" ) == 0 )
+            *precision = GTM::Precision_F32;
+        else
+            return false;
+
+        return true;
+    }
+
+    void ReportLLHDifference( f64* reference, s32 referenceCycles, f64* llh, s32 cycles )
+    {
+        s32 count = Utils::Min( referenceCycles, cycles );
+
+        f64 maxDifference       = 0;
+        s32 maxDifferenceCycle  = 0;
+        for( s32 i = 0; i < count; ++i )
+        {
+            f64 difference = fabs( llh[ i ] - reference[ i ] );
+            if( difference > maxDifference )
+            {
+                maxDifference       = difference;
+                maxDifferenceCycle  = i;
+            }
+        }
+
+        f64 finalReference  = reference[ referenceCycles - 1 ];
+        f64 finalLLH        = llh[ cycles - 1 ];
+
+        LOG( "llh against f64: cycles %d vs %d\n", cycles, referenceCycles );
+        LOG( "    final llh %f vs %f, difference %g ( relative %g )\n", finalLLH, finalReference,
+             finalLLH - finalReference, fabs( finalLLH - finalReference ) / fmax( fabs( finalReference ), 1.0 ) );
+        LOG( "    largest difference over the first %d cycles %g at cycle %d\n", count, maxDifference, maxDifferenceCycle + 1 );
+    }
+
+    bool ParseS32( char* string, s32* value )
+    {
+        char* end   = NULL;
+        s64 result  = strtol( string, &end, 10 );
+
+        if( end == string || *end != '\0' || result < S32_MIN || result > S32_MAX )
+            return false;
+
+        *value = ( s32 ) result;
+        return true;
+    }
+
+    bool ParseF64( char* string, f64* value )
+    {
+        char* end   = NULL;
+        f64 result  = strtod( string, &end );
+
+        if( end == string || *end != '\0' || !( result >= 0 ) )
+            return false;
+
+        *value = result;
+        return true;
+    }
+}
+
+
+s32 main( s32 argc, char** argv )
+{
+    if( argc < 2 )
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    char* dataFilename      = argv[ 1 ];
+    char* outputDirectory   = NULL;
+
+    GTM::Parameters overrides   = { 0, 0, 0, 0 };
+    GTM::Precision precision    = GTM::GetPrecision();
+    f64 pruning                 = GTM::GetPruning();
+    bool compare                = false;
+
+    LinuxPlatform::Affinity affinity    = LinuxPlatform::Affinity_None;
+    Platform::NumaPolicy numaPolicy     = Platform::NumaPolicy_FirstTouch;
+    s32 threadCount                     = 0;
+
+    for( s32 i = 2; i < argc; ++i )
+    {
+        char* option = argv[ i ];
+
+        if( strcmp( option, "-o" ) == 0 && i + 1 < argc )
+        {
+            outputDirectory = argv[ ++i ];
+            continue;
+        }
+
+        if( strcmp( option, "-c" ) == 0 )
+        {
+            compare = true;
+            continue;
+        }
+
+        if( strcmp( option, "-p" ) == 0 )
+        {
+            if( i + 1 >= argc || !ParsePrecision( argv[ ++i ], &precision ) )
+            {
+                LOG( "invalid option %s\n", option );
+                PrintUsage();
+                return 1;
+            }
+
+            continue;
+        }
+
+        if( strcmp( option, "-e" ) == 0 )
+        {
+            if( i + 1 >= argc || !ParseF64( argv[ ++i ], &pruning ) )
+            {
+                LOG( "invalid option %s\n", option );
+                PrintUsage();
+                return 1;
+            }
+
+            continue;
+        }
+
+        if( strcmp( option, "-a" ) == 0 || strcmp( option, "-n" ) == 0 )
+        {
+            bool valid = i + 1 < argc;
+
+            if( valid && option[ 1 ] == 'a' )
+                valid = ParseAffinity( argv[ ++i ], &affinity );
+            else if( valid )
+                valid = ParseNumaPolicy( argv[ ++i ], &numaPolicy );
+
+            if( !valid )
+            {
+                LOG( "invalid option %s\n", option );
+                PrintUsage();
+                return 1;
+            }
+
+            continue;
+        }
+
+        s32* value = NULL;
+        if( strcmp( option, "-b" ) == 0 )
+            value = &overrides.noBasisFunction;
+        else if( strcmp( option, "-l" ) == 0 )
+            value = &overrides.noLatVarSample;
+        else if( strcmp( option, "-s" ) == 0 )
+            value = &overrides.s;
+        else if( strcmp( option, "-d" ) == 0 )
+            value = &overrides.latentDimensions;
+        else if( strcmp( option, "-t" ) == 0 )
+            value = &threadCount;
+
+        if( !value || i + 1 >= argc || !ParseS32( argv[ ++i ], value ) )
+        {
+            LOG( "invalid option %s\n", option );
+            PrintUsage();
+            return 1;
+        }
+    }
+
+
+    LinuxPlatform::StartWorkerThreads( affinity, numaPolicy, threadCount );
+
+
+    f32 loadTime;
+    {
+        TIMED_BLOCK( &loadTime );
+
+        if( !GTM::LoadGTMData( dataFilename ) )
+            return 1;
+    }
+    LOG( "load time: %fms\n", loadTime * 1000.0f );
+
+    GTM::Parameters parameters = GTM::GetParameters();
+
+    if( overrides.noBasisFunction )
+        parameters.noBasisFunction = overrides.noBasisFunction;
+    if( overrides.noLatVarSample )
+        parameters.noLatVarSample = overrides.noLatVarSample;
+    if( overrides.s )
+        parameters.s = overrides.s;
+    if( overrides.latentDimensions )
+        parameters.latentDimensions = overrides.latentDimensions;
+
+    GTM::SetParameters( parameters );
+
+    if( !GTM::ValidateParameters() )
+    {
+        LOG( "invalid parameters: noBasisFunction %d, noLatVarSample %d, s %d, latentDimensions %d\n",
+             parameters.noBasisFunction, parameters.noLatVarSample, parameters.s, parameters.latentDimensions );
+        return 1;
+    }
+
+
+    f64* referenceLLH       = NULL;
+    s32 referenceCycles     = 0;
+
+    if( compare )
+    {
+        GTM::SetPrecision( GTM::Precision_F64 );
+        GTM::SetPruning( 0 );
+        GTM::Setup();
+        GTM::TrainUntilConverged();
+
+        referenceCycles = GTM::GetCycles();
+        referenceLLH    = new f64[ referenceCycles ];
+        memcpy( referenceLLH, GTM::GetLLH(), sizeof( f64 ) * referenceCycles );
+    }
+
+    GTM::SetPrecision( precision );
+    GTM::SetPruning( pruning );
+
+
+    f32 setupTime;
+    {
+        TIMED_BLOCK( &setupTime );
+        GTM::Setup();
+    }
+    LOG( "setup time: %fms\n", setupTime * 1000.0f );
+
+
+    f32 trainingTime;
+    {
+        TIMED_BLOCK( &trainingTime );
+        GTM::TrainUntilConverged();
+    }
+    LOG( "training time: %fms\n", trainingTime * 1000.0f );
+    LOG( "total time: %fms\n", ( loadTime + setupTime + trainingTime ) * 1000.0f );
+
+
+    if( compare )
+    {
+        ReportLLHDifference( referenceLLH, referenceCycles, GTM::GetLLH(), GTM::GetCycles() );
+        delete [] referenceLLH;
+    }
+
+
+    GTM::SaveResults( outputDirectory, loadTime + setupTime + trainingTime );
+
+    return 0;
+}
\ No newline at end of file
@@ -2,22 +2,15 @@
 #include "../shared/platform.h"
 #include "../shared/types.h"
 #include "../shared/utils.h"
+#include "linux_platform.h"
 
-#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 
-#include <sys/sysinfo.h>
-#include <pthread.h>
-#include <semaphore.h>
 #include <X11/Xlib.h>
 #include <GL/glx.h>
 
-#include <atomic>
-typedef std::atomic_uint au32;
-
 
 namespace
 {
@@ -295,146 +288,12 @@ namespace
 
         return true;
     }
-
-
-    struct ThreadInfo
-    {
-        s32 threadIndex;
-        pthread_t threadId;
-    };
-
-    struct WorkQueueEntry
-    {
-        Platform::WorkCallback* callback;
-        void* data;
-    };
-
-
-    WorkQueueEntry workQueueEntry[ 256 ];
-    const u32 QUEUE_ENTRY_MASK          = ARRAY_COUNT( workQueueEntry ) - 1;
-    u32 workQueueEntryStartedCount      = 0;
-    au32 workQueueEntryCompletedCount   = { 0 };
-    au32 workQueueEntryReadIndex        = { 0 };
-    au32 workQueueEntryWriteIndex       = { 0 };
-
-    sem_t semaphore;
-    ThreadInfo* threadInfo;
-
-
-    bool DoWork( ThreadInfo* info )
-    {
-        bool result = false;
-
-        u32 readIndex = workQueueEntryReadIndex;
-        if( readIndex != atomic_load( &workQueueEntryWriteIndex ) )
-        {
-            result = true;
-
-            u32 nextReadIndex = ( readIndex + 1 ) & QUEUE_ENTRY_MASK;
-            if( atomic_compare_exchange_weak( &workQueueEntryReadIndex, &readIndex, nextReadIndex ) )
-            {
-                WorkQueueEntry entry = workQueueEntry[ readIndex ];
-                entry.callback( info->threadIndex, entry.data );
-
-                ++workQueueEntryCompletedCount;
-            }
-        }
-
-        return result;
-    }
-
-    void* ThreadProc( void* arg )
-    {
-        ThreadInfo *info = ( ThreadInfo* ) arg;
-
-        while( true )
-        {
-            if( !DoWork( info ) )
-                sem_wait( &semaphore );
-        };
-    }
-}
-
-namespace Platform
-{
-    void Log( char* string, ... )
-    {
-        va_list args;
-        va_start( args, string );
-        vprintf( string, args );
-        va_end( args );
-    }
-
-
-    f64 GetTime()
-    {
-        f64 result = 0;
-
-        timespec timeSpec;
-        if( clock_gettime( CLOCK_MONOTONIC_RAW, &timeSpec ) == 0 )
-            result = timeSpec.tv_sec + ( timeSpec.tv_nsec * 1e-9 );
-
-        return result;
-    }
-
-
-    s32 GetProcessorCount()
-    {
-        s32 result = Utils::Max( get_nprocs(), 1 );
-        return result;
-    }
-
-    void FinishWork()
-    {
-        ASSERT( pthread_equal( pthread_self(), threadInfo[ 0 ].threadId ) );
-
-        while( atomic_load( &workQueueEntryCompletedCount ) < workQueueEntryStartedCount )
-            DoWork( &threadInfo[ 0 ] );
-
-        workQueueEntryStartedCount = 0;
-        atomic_store( &workQueueEntryCompletedCount, 0u );
-    }
-
-    void AddWorkQueueEntry( WorkCallback* callback, void* data )
-    {
-        ASSERT( pthread_equal( pthread_self(), threadInfo[ 0 ].threadId ) );
-
-        u32 nextWriteIndex = ( workQueueEntryWriteIndex + 1 ) & QUEUE_ENTRY_MASK;
-        if( nextWriteIndex == atomic_load( &workQueueEntryReadIndex ) )
-        {
-            Log( "Work queue full!\n" );
-            FinishWork();
-        }
-
-        WorkQueueEntry* entry = &workQueueEntry[ workQueueEntryWriteIndex ];
-        entry->callback = callback;
-        entry->data = data;
-
-        ++workQueueEntryStartedCount;
-        atomic_store( &workQueueEntryWriteIndex, nextWriteIndex );
-
-        sem_post( &semaphore );
-    }
 }
 
 
 s32 main()
 {
-    ASSERT( Utils::IsPowerOf2( ARRAY_COUNT( workQueueEntry ) ) );
-
-    s32 threadCount             = Platform::GetProcessorCount();
-    threadInfo                  = new ThreadInfo[ threadCount ];
-    threadInfo[ 0 ].threadIndex = 0;
-    threadInfo[ 0 ].threadId    = pthread_self();
-
-    sem_init( &semaphore, 0, 0 );
-
-    for( s32 i = 1; i < threadCount; ++i )
-    {
-        threadInfo[ i ].threadIndex = i;
-
-        pthread_create( &threadInfo[ i ].threadId, NULL, ThreadProc, &threadInfo[ i ] );
-    }
+    LinuxPlatform::StartWorkerThreads();
 
 
 	if( !CreateWindowGL( fullscreen ) )
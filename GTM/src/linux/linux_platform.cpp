@@ -0,0 +1,971 @@
+#include "linux_platform.h"
+#include "../shared/platform.h"
+#define UTILS_FUNCTIONS
+#include "../shared/utils.h"
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/sysinfo.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <unistd.h>
+
+#include <atomic>
+typedef std::atomic_uint au32;
+typedef std::atomic_llong as64;
+
+
+namespace
+{
+    struct WorkQueueEntry
+    {
+        Platform::WorkCallback* callback;
+        void* data;
+
+        //the count of unfinished entries the entry was added under, it drops when the entry is done
+        au32* pendingCount;
+    };
+
+    //chase-lev deque: the owning thread pushes and pops at bottom, other threads steal the oldest entries from top;
+    //a thief reads its entry before the compare exchange on top that claims it, and the owner cannot write over that
+    //slot until top has moved past it
+    const s64 WORK_DEQUE_SIZE = 4096;
+    const s64 WORK_DEQUE_MASK = WORK_DEQUE_SIZE - 1;
+
+    struct ThreadInfo
+    {
+        s32 threadIndex;
+        pthread_t threadId;
+
+        //the cpu the thread is pinned to, -1 when it is not, and that cpu's NUMA node counted from 0
+        s32 cpu;
+        s32 node;
+
+        ALIGN_64 as64 top;
+        ALIGN_64 as64 bottom;
+        WorkQueueEntry entries[ WORK_DEQUE_SIZE ];
+
+        //entries the thread added outside of any callback that have not finished yet
+        ALIGN_64 au32 pendingCount;
+    };
+
+
+    sem_t semaphore;
+    au32 sleepingCount = { 0 };
+
+    s32 threadCount;
+    ThreadInfo* threadInfo;
+
+
+    struct ParallelJob
+    {
+        s32 startIndex;
+        s32 endIndexPlus1;
+
+        //one of the two is set
+        Platform::ParallelForCallback* callback;
+        Platform::ParallelReduceCallback* reduceCallback;
+        void* data;
+
+        f64 result;
+    };
+
+    const s32 MAX_PARALLEL_JOB_COUNT = 256;
+
+
+    //nodes only count for scheduling when the threads are pinned, systemNodeMask is every node for interleaving
+    const s32 MAX_NODE_COUNT = 64;
+    s32 nodeCount               = 1;
+    u64 systemNodeMask          = 0;
+    s32 systemNodeCount         = 1;
+    Platform::NumaPolicy numaPolicy;
+
+    //smaller allocations stay wherever they are first touched
+    const s64 NUMA_MIN_PLACE_SIZE   = 1024 * 1024;
+    const s32 MPOL_INTERLEAVE       = 3;
+
+    struct CpuInfo
+    {
+        s32 cpu;
+        s32 node;
+        s32 package;
+        s32 core;
+        //0 for the first hardware thread of a core, 1 for the next and so on
+        s32 sibling;
+    };
+
+    //the jobs of one node in a node partitioned run, claimed one at a time
+    struct NodeJobs
+    {
+        ALIGN_64 au32 next;
+        s32 startIndex;
+        s32 endIndexPlus1;
+    };
+
+    struct NodeClaimData
+    {
+        ParallelJob* jobs;
+        NodeJobs* nodes;
+    };
+
+
+    const s32 MAX_TASK_COUNT            = 64;
+    const s32 MAX_TASK_DEPENDENT_COUNT  = 8;
+
+    struct Task
+    {
+        Platform::WorkCallback* callback;
+        void* data;
+
+        s32 dependencyCount;
+        //dependencies that have not run yet, whoever takes it to 0 queues the task
+        au32 remainingCount;
+
+        s32 dependentCount;
+        s32 dependents[ MAX_TASK_DEPENDENT_COUNT ];
+    };
+
+    Task tasks[ MAX_TASK_COUNT ];
+    s32 taskCount = 0;
+
+
+    thread_local s32 currentThreadIndex     = -1;
+    //entries added now count against this, the thread's own count outside a callback and a count of the running
+    //callback's own inside one, so FinishWork in a callback only waits for what that callback added
+    thread_local au32* currentPendingCount  = 0;
+
+
+    bool PushWork( ThreadInfo* info, WorkQueueEntry entry )
+    {
+        s64 bottom  = atomic_load_explicit( &info->bottom, std::memory_order_relaxed );
+        s64 top     = atomic_load_explicit( &info->top, std::memory_order_acquire );
+
+        if( bottom - top >= WORK_DEQUE_SIZE )
+            return false;
+
+        info->entries[ bottom & WORK_DEQUE_MASK ] = entry;
+        atomic_store_explicit( &info->bottom, bottom + 1, std::memory_order_release );
+
+        return true;
+    }
+
+    bool PopWork( ThreadInfo* info, WorkQueueEntry* entry )
+    {
+        s64 bottom = atomic_load_explicit( &info->bottom, std::memory_order_relaxed ) - 1;
+        atomic_store_explicit( &info->bottom, bottom, std::memory_order_relaxed );
+        atomic_thread_fence( std::memory_order_seq_cst );
+        s64 top = atomic_load_explicit( &info->top, std::memory_order_relaxed );
+
+        bool result = top <= bottom;
+
+        if( result )
+        {
+            *entry = info->entries[ bottom & WORK_DEQUE_MASK ];
+
+            //the last entry can be stolen at the same time, whoever moves top gets it
+            if( top == bottom )
+            {
+                result = atomic_compare_exchange_strong_explicit( &info->top, &top, top + 1,
+                                                                  std::memory_order_seq_cst, std::memory_order_relaxed );
+                atomic_store_explicit( &info->bottom, bottom + 1, std::memory_order_relaxed );
+            }
+        }
+        else
+        {
+            atomic_store_explicit( &info->bottom, bottom + 1, std::memory_order_relaxed );
+        }
+
+        return result;
+    }
+
+    bool StealWork( ThreadInfo* info, WorkQueueEntry* entry )
+    {
+        s64 top = atomic_load_explicit( &info->top, std::memory_order_acquire );
+        atomic_thread_fence( std::memory_order_seq_cst );
+        s64 bottom = atomic_load_explicit( &info->bottom, std::memory_order_acquire );
+
+        if( top >= bottom )
+            return false;
+
+        *entry = info->entries[ top & WORK_DEQUE_MASK ];
+
+        bool result = atomic_compare_exchange_strong_explicit( &info->top, &top, top + 1,
+                                                               std::memory_order_seq_cst, std::memory_order_relaxed );
+        return result;
+    }
+
+    bool HasWork()
+    {
+        for( s32 i = 0; i < threadCount; ++i )
+        {
+            if( atomic_load( &threadInfo[ i ].top ) < atomic_load( &threadInfo[ i ].bottom ) )
+                return true;
+        }
+
+        return false;
+    }
+
+    //wakes one sleeping worker, which wakes the next if it still finds work after stealing,
+    //so a batch of entries costs the thread adding them a single post
+    void WakeWorker()
+    {
+        atomic_thread_fence( std::memory_order_seq_cst );
+        if( atomic_load( &sleepingCount ) > 0 )
+            sem_post( &semaphore );
+    }
+
+    bool DoWork( ThreadInfo* info );
+
+    //runs queued work until pendingCount drops to 0
+    void WaitForWork( ThreadInfo* info, au32* pendingCount )
+    {
+        while( atomic_load_explicit( pendingCount, std::memory_order_acquire ) > 0 )
+        {
+            if( !DoWork( info ) )
+                sched_yield();
+        }
+    }
+
+    //entries a callback adds and does not finish itself are finished before it counts as done
+    void RunWork( ThreadInfo* info, WorkQueueEntry entry )
+    {
+        au32 pendingCount;
+        atomic_init( &pendingCount, 0u );
+
+        au32* previousPendingCount  = currentPendingCount;
+        currentPendingCount         = &pendingCount;
+
+        entry.callback( info->threadIndex, entry.data );
+        WaitForWork( info, &pendingCount );
+
+        currentPendingCount = previousPendingCount;
+
+        atomic_fetch_sub_explicit( entry.pendingCount, 1u, std::memory_order_release );
+    }
+
+    //runs the newest entry of the thread's own deque, or else the oldest entry of another thread's
+    bool DoWork( ThreadInfo* info )
+    {
+        WorkQueueEntry entry;
+
+        if( PopWork( info, &entry ) )
+        {
+            RunWork( info, entry );
+            return true;
+        }
+
+        for( s32 i = 1; i < threadCount; ++i )
+        {
+            ThreadInfo* victim = &threadInfo[ ( info->threadIndex + i ) % threadCount ];
+
+            if( StealWork( victim, &entry ) )
+            {
+                if( atomic_load_explicit( &victim->top, std::memory_order_relaxed ) <
+                    atomic_load_explicit( &victim->bottom, std::memory_order_relaxed ) )
+                    WakeWorker();
+
+                RunWork( info, entry );
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void PinThread( ThreadInfo* info )
+    {
+        if( info->cpu < 0 )
+            return;
+
+        cpu_set_t cpuSet;
+        CPU_ZERO( &cpuSet );
+        CPU_SET( info->cpu, &cpuSet );
+
+        if( pthread_setaffinity_np( pthread_self(), sizeof( cpuSet ), &cpuSet ) != 0 )
+            Platform::Log( "could not pin thread %d to cpu %d\n", info->threadIndex, info->cpu );
+    }
+
+    void* ThreadProc( void* arg )
+    {
+        ThreadInfo *info    = ( ThreadInfo* ) arg;
+        currentThreadIndex  = info->threadIndex;
+        currentPendingCount = &info->pendingCount;
+
+        PinThread( info );
+
+        while( true )
+        {
+            if( DoWork( info ) )
+                continue;
+
+            //sleepingCount goes up before the last look for work and AddWorkQueueEntry reads it after pushing,
+            //so either this thread sees the new entry or the adding thread sees it sleeping and posts
+            atomic_fetch_add( &sleepingCount, 1u );
+
+            if( !HasWork() )
+                sem_wait( &semaphore );
+
+            atomic_fetch_sub( &sleepingCount, 1u );
+        };
+    }
+
+
+    void RunParallelJob( s32 threadIndex, void* data )
+    {
+        ParallelJob* job = ( ParallelJob* ) data;
+
+        if( job->reduceCallback )
+            job->result = job->reduceCallback( threadIndex, job->startIndex, job->endIndexPlus1, job->data );
+        else
+            job->callback( threadIndex, job->startIndex, job->endIndexPlus1, job->data );
+    }
+
+    s32 SplitParallelJobs( s32 count, s32 grain, ParallelJob* jobs )
+    {
+        if( grain <= 0 )
+            grain = Platform::GetGrain( 1 );
+
+        s64 jobCount        = ( ( s64 ) count + grain - 1 ) / grain;
+        s32 maxJobCount     = Utils::Min( threadCount * Platform::PARALLEL_JOBS_PER_THREAD, MAX_PARALLEL_JOB_COUNT );
+        jobCount            = jobCount < maxJobCount ? jobCount : maxJobCount;
+
+        for( s32 i = 0; i < jobCount; ++i )
+        {
+            jobs[ i ]                   = {};
+            jobs[ i ].startIndex        = ( s32 ) ( count * i / jobCount );
+            jobs[ i ].endIndexPlus1     = ( s32 ) ( count * ( i + 1 ) / jobCount );
+        }
+
+        return ( s32 ) jobCount;
+    }
+
+    //runs the jobs of the thread's own node, then helps the other nodes with theirs
+    void ClaimNodeJobs( s32 threadIndex, void* data )
+    {
+        NodeClaimData* claimData    = ( NodeClaimData* ) data;
+        s32 node                    = threadInfo[ threadIndex ].node;
+
+        for( s32 n = 0; n < nodeCount; ++n )
+        {
+            NodeJobs* nodeJobs = &claimData->nodes[ ( node + n ) % nodeCount ];
+
+            while( true )
+            {
+                s32 i = nodeJobs->startIndex + ( s32 ) atomic_fetch_add_explicit( &nodeJobs->next, 1u, std::memory_order_relaxed );
+                if( i >= nodeJobs->endIndexPlus1 )
+                    break;
+
+                RunParallelJob( threadIndex, &claimData->jobs[ i ] );
+            }
+        }
+    }
+
+    //the jobs count against a count of their own, so waiting for them leaves other queued work alone; with pinned
+    //threads on several nodes the jobs are split between the nodes in index order, so row ranges run on the node
+    //whose threads first touched them in an earlier loop over the same rows, and every thread takes a claiming entry
+    //instead of one job
+    void RunParallelJobs( ParallelJob* jobs, s32 jobCount )
+    {
+        ASSERT( currentThreadIndex >= 0 );
+
+        ThreadInfo* info = &threadInfo[ currentThreadIndex ];
+
+        if( jobCount == 1 )
+        {
+            RunParallelJob( info->threadIndex, &jobs[ 0 ] );
+            return;
+        }
+
+        au32 pendingCount;
+        atomic_init( &pendingCount, 0u );
+
+        au32* previousPendingCount  = currentPendingCount;
+        currentPendingCount         = &pendingCount;
+
+        if( nodeCount > 1 )
+        {
+            NodeJobs nodes[ MAX_NODE_COUNT ];
+            for( s32 n = 0; n < nodeCount; ++n )
+            {
+                atomic_init( &nodes[ n ].next, 0u );
+                nodes[ n ].startIndex       = jobCount * n / nodeCount;
+                nodes[ n ].endIndexPlus1    = jobCount * ( n + 1 ) / nodeCount;
+            }
+
+            NodeClaimData claimData = { jobs, nodes };
+            s32 claimCount          = Utils::Min( jobCount, threadCount );
+
+            for( s32 i = 1; i < claimCount; ++i )
+            {
+                WorkQueueEntry entry = { ClaimNodeJobs, &claimData, &pendingCount };
+                atomic_fetch_add_explicit( &pendingCount, 1u, std::memory_order_relaxed );
+
+                if( !PushWork( info, entry ) )
+                    RunWork( info, entry );
+            }
+
+            WakeWorker();
+
+            ClaimNodeJobs( info->threadIndex, &claimData );
+            WaitForWork( info, &pendingCount );
+        }
+        else
+        {
+            for( s32 i = 1; i < jobCount; ++i )
+            {
+                WorkQueueEntry entry = { RunParallelJob, &jobs[ i ], &pendingCount };
+                atomic_fetch_add_explicit( &pendingCount, 1u, std::memory_order_relaxed );
+
+                if( !PushWork( info, entry ) )
+                    RunWork( info, entry );
+            }
+
+            WakeWorker();
+
+            RunParallelJob( info->threadIndex, &jobs[ 0 ] );
+            WaitForWork( info, &pendingCount );
+        }
+
+        currentPendingCount = previousPendingCount;
+    }
+
+
+    //a dependent queued here is finished before this task counts as done, so RunTasks only has to wait for the roots
+    void RunTask( s32 threadIndex, void* data )
+    {
+        Task* task = ( Task* ) data;
+        task->callback( threadIndex, task->data );
+
+        for( s32 i = 0; i < task->dependentCount; ++i )
+        {
+            Task* dependent = &tasks[ task->dependents[ i ] ];
+
+            if( atomic_fetch_sub_explicit( &dependent->remainingCount, 1u, std::memory_order_acq_rel ) == 1 )
+                Platform::AddWorkQueueEntry( RunTask, dependent );
+        }
+    }
+
+
+    bool ReadS32( char* path, s32* value )
+    {
+        FILE* file = fopen( path, "r" );
+        if( !file )
+            return false;
+
+        bool result = fscanf( file, "%d", value ) == 1;
+        fclose( file );
+
+        return result;
+    }
+
+    //the node of a cpu is the nodeN entry in its sysfs directory, 0 on kernels without NUMA
+    s32 GetCpuNode( s32 cpu )
+    {
+        char path[ 64 ];
+        snprintf( path, sizeof( path ), "/sys/devices/system/cpu/cpu%d", cpu );
+
+        s32 result = 0;
+
+        DIR* directory = opendir( path );
+        if( directory )
+        {
+            dirent* entry;
+            while( ( entry = readdir( directory ) ) )
+            {
+                s32 node;
+                if( sscanf( entry->d_name, "node%d", &node ) == 1 )
+                {
+                    result = node;
+                    break;
+                }
+            }
+
+            closedir( directory );
+        }
+
+        return result;
+    }
+
+    s32 CompareCpus( const void* a, const void* b )
+    {
+        CpuInfo* cpu0 = ( CpuInfo* ) a;
+        CpuInfo* cpu1 = ( CpuInfo* ) b;
+
+        s32 keys0[] = { cpu0->node, cpu0->sibling, cpu0->package, cpu0->core, cpu0->cpu };
+        s32 keys1[] = { cpu1->node, cpu1->sibling, cpu1->package, cpu1->core, cpu1->cpu };
+
+        for( s32 i = 0; i < ( s32 ) ARRAY_COUNT( keys0 ); ++i )
+        {
+            if( keys0[ i ] != keys1[ i ] )
+                return keys0[ i ] < keys1[ i ] ? -1 : 1;
+        }
+
+        return 0;
+    }
+
+    //the cpus the process may run on, grouped by node, first hardware threads of every core before their siblings,
+    //with only the first hardware threads for Affinity_Cores; returns 0 when sysfs has no topology
+    s32 GetCpus( LinuxPlatform::Affinity affinity, CpuInfo** cpus )
+    {
+        cpu_set_t allowed;
+        if( sched_getaffinity( 0, sizeof( allowed ), &allowed ) != 0 )
+            return 0;
+
+        s32 cpuCount    = Utils::Min( get_nprocs_conf(), CPU_SETSIZE );
+        CpuInfo* result = new CpuInfo[ cpuCount ];
+        s32 count       = 0;
+
+        for( s32 cpu = 0; cpu < cpuCount; ++cpu )
+        {
+            if( !CPU_ISSET( cpu, &allowed ) )
+                continue;
+
+            CpuInfo* info = &result[ count ];
+            info->cpu       = cpu;
+            info->node      = GetCpuNode( cpu );
+            info->sibling   = 0;
+
+            char path[ 96 ];
+            snprintf( path, sizeof( path ), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu );
+            bool valid = ReadS32( path, &info->package );
+            snprintf( path, sizeof( path ), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu );
+            valid = valid && ReadS32( path, &info->core );
+
+            if( !valid )
+            {
+                delete [] result;
+                return 0;
+            }
+
+            ++count;
+        }
+
+        //with every sibling 0 the sort puts the hardware threads of a core next to each other
+        qsort( result, count, sizeof( CpuInfo ), CompareCpus );
+
+        for( s32 i = 1; i < count; ++i )
+        {
+            if( result[ i ].node == result[ i - 1 ].node && result[ i ].package == result[ i - 1 ].package &&
+                result[ i ].core == result[ i - 1 ].core )
+                result[ i ].sibling = result[ i - 1 ].sibling + 1;
+        }
+
+        if( affinity == LinuxPlatform::Affinity_Cores )
+        {
+            s32 coreCount = 0;
+            for( s32 i = 0; i < count; ++i )
+            {
+                if( result[ i ].sibling == 0 )
+                    result[ coreCount++ ] = result[ i ];
+            }
+
+            count = coreCount;
+        }
+
+        qsort( result, count, sizeof( CpuInfo ), CompareCpus );
+
+        *cpus = result;
+        return count;
+    }
+
+    //cpu.max holds "<quota> <period>" or "max <period>"
+    f64 ReadCgroupV2Quota( char* directory )
+    {
+        char path[ 600 ];
+        snprintf( path, sizeof( path ), "%s/cpu.max", directory );
+
+        FILE* file = fopen( path, "r" );
+        if( !file )
+            return 0;
+
+        f64 result = 0;
+
+        char quota[ 32 ];
+        s64 period;
+        if( fscanf( file, "%31s %lld", quota, &period ) == 2 && strcmp( quota, "max" ) != 0 && period > 0 )
+            result = atof( quota ) / ( f64 ) period;
+
+        fclose( file );
+        return result;
+    }
+
+    //cpu.cfs_quota_us is -1 when there is no quota
+    f64 ReadCgroupV1Quota( char* directory )
+    {
+        char path[ 600 ];
+        s32 quota;
+        s32 period;
+
+        snprintf( path, sizeof( path ), "%s/cpu.cfs_quota_us", directory );
+        if( !ReadS32( path, &quota ) || quota <= 0 )
+            return 0;
+
+        snprintf( path, sizeof( path ), "%s/cpu.cfs_period_us", directory );
+        if( !ReadS32( path, &period ) || period <= 0 )
+            return 0;
+
+        return ( f64 ) quota / ( f64 ) period;
+    }
+
+    //the smallest quota in cpus on the cgroup path under root and its parents up to root, 0 when none is set,
+    //as a limit on a parent cgroup holds for everything under it
+    f64 GetCgroupQuota( char* root, char* cgroupPath, bool v2 )
+    {
+        char directory[ 512 ];
+        snprintf( directory, sizeof( directory ), "%s%s", root, cgroupPath );
+
+        s32 rootLength  = ( s32 ) strlen( root );
+        f64 result      = 0;
+
+        while( true )
+        {
+            f64 quota = v2 ? ReadCgroupV2Quota( directory ) : ReadCgroupV1Quota( directory );
+            if( quota > 0 && ( result == 0 || quota < result ) )
+                result = quota;
+
+            char* slash = strrchr( directory, '/' );
+            if( !slash || slash - directory < rootLength )
+                break;
+
+            *slash = 0;
+        }
+
+        return result;
+    }
+
+    //the cpu quota of the process's cgroups, from v2 lines "0::<path>" and the v1 line whose controllers include cpu
+    f64 GetCpuQuota()
+    {
+        FILE* file = fopen( "/proc/self/cgroup", "r" );
+        if( !file )
+            return 0;
+
+        f64 result = 0;
+
+        char line[ 512 ];
+        while( fgets( line, sizeof( line ), file ) )
+        {
+            line[ strcspn( line, "\n" ) ] = 0;
+
+            char* controllers   = strchr( line, ':' );
+            char* cgroupPath    = controllers ? strchr( controllers + 1, ':' ) : 0;
+            if( !cgroupPath )
+                continue;
+
+            *cgroupPath++ = 0;
+            ++controllers;
+
+            f64 quota = 0;
+            if( *controllers == 0 )
+            {
+                quota = GetCgroupQuota( "/sys/fs/cgroup", cgroupPath, true );
+                if( quota == 0 )
+                    quota = GetCgroupQuota( "/sys/fs/cgroup/unified", cgroupPath, true );
+            }
+            else
+            {
+                bool cpuController = false;
+                for( char* controller = strtok( controllers, "," ); controller; controller = strtok( 0, "," ) )
+                    cpuController = cpuController || strcmp( controller, "cpu" ) == 0;
+
+                if( cpuController )
+                {
+                    quota = GetCgroupQuota( "/sys/fs/cgroup/cpu", cgroupPath, false );
+                    if( quota == 0 )
+                        quota = GetCgroupQuota( "/sys/fs/cgroup/cpu,cpuacct", cgroupPath, false );
+                }
+            }
+
+            if( quota > 0 && ( result == 0 || quota < result ) )
+                result = quota;
+        }
+
+        fclose( file );
+        return result;
+    }
+
+    //the cpus the process can actually use: its affinity mask, cut down to a cgroup quota rounded up to whole cpus
+    s32 GetCpuBudget()
+    {
+        s32 result = get_nprocs();
+
+        cpu_set_t allowed;
+        if( sched_getaffinity( 0, sizeof( allowed ), &allowed ) == 0 )
+            result = CPU_COUNT( &allowed );
+
+        f64 quota = GetCpuQuota();
+        if( quota > 0 )
+            result = Utils::Min( result, ( s32 ) ceil( quota ) );
+
+        return Utils::Max( result, 1 );
+    }
+
+    //an explicit count, else GTM_THREAD_COUNT from the environment, else the cpu budget
+    s32 GetRequestedThreadCount( s32 requestedCount )
+    {
+        if( requestedCount > 0 )
+            return requestedCount;
+
+        char* environmentCount = getenv( "GTM_THREAD_COUNT" );
+        if( environmentCount )
+        {
+            s32 count = atoi( environmentCount );
+            if( count > 0 )
+                return count;
+
+            Platform::Log( "ignoring GTM_THREAD_COUNT=%s\n", environmentCount );
+        }
+
+        return GetCpuBudget();
+    }
+
+    void GetSystemNodes()
+    {
+        systemNodeMask  = 0;
+        systemNodeCount = 0;
+
+        for( s32 node = 0; node < MAX_NODE_COUNT; ++node )
+        {
+            char path[ 64 ];
+            snprintf( path, sizeof( path ), "/sys/devices/system/node/node%d", node );
+
+            if( access( path, F_OK ) == 0 )
+            {
+                systemNodeMask |= 1ull << node;
+                ++systemNodeCount;
+            }
+        }
+
+        systemNodeCount = Utils::Max( systemNodeCount, 1 );
+    }
+}
+
+namespace Platform
+{
+    void Log( char* string, ... )
+    {
+        va_list args;
+        va_start( args, string );
+        vprintf( string, args );
+        va_end( args );
+    }
+
+
+    f64 GetTime()
+    {
+        f64 result = 0;
+
+        timespec timeSpec;
+        if( clock_gettime( CLOCK_MONOTONIC_RAW, &timeSpec ) == 0 )
+            result = timeSpec.tv_sec + ( timeSpec.tv_nsec * 1e-9 );
+
+        return result;
+    }
+
+
+    //the number of threads in the pool once it is started, the cpu budget before
+    s32 GetProcessorCount()
+    {
+        s32 result = Utils::Max( threadCount > 0 ? threadCount : GetCpuBudget(), 1 );
+        return result;
+    }
+
+    s32 GetNodeCount()
+    {
+        return nodeCount;
+    }
+
+    void PlaceMemory( void* memory, s64 size )
+    {
+        if( numaPolicy != NumaPolicy_Interleave || systemNodeCount < 2 || size < NUMA_MIN_PLACE_SIZE )
+            return;
+
+        //only the pages wholly inside the allocation, the ones it shares belong to its neighbours too
+        u64 pageSize    = ( u64 ) sysconf( _SC_PAGESIZE );
+        u64 start       = ( ( u64 ) memory + pageSize - 1 ) & ~( pageSize - 1 );
+        u64 end         = ( ( u64 ) memory + size ) & ~( pageSize - 1 );
+
+        if( end <= start )
+            return;
+
+        unsigned long nodeMask = ( unsigned long ) systemNodeMask;
+        if( syscall( SYS_mbind, start, end - start, MPOL_INTERLEAVE, &nodeMask, MAX_NODE_COUNT + 1, 0 ) != 0 )
+            Log( "could not interleave %lld bytes over the NUMA nodes\n", size );
+    }
+
+    //waits for the entries added by the calling thread, or by the calling callback inside one, running queued work
+    //in the meantime; per thread buffers indexed by threadIndex must not be held across the call, as the work run
+    //while waiting uses them too
+    void FinishWork()
+    {
+        ASSERT( currentThreadIndex >= 0 );
+
+        WaitForWork( &threadInfo[ currentThreadIndex ], currentPendingCount );
+    }
+
+    //any thread of the pool can add work; when its deque is full the entry runs straight away instead
+    void AddWorkQueueEntry( WorkCallback* callback, void* data )
+    {
+        ASSERT( currentThreadIndex >= 0 );
+
+        ThreadInfo* info        = &threadInfo[ currentThreadIndex ];
+        WorkQueueEntry entry    = { callback, data, currentPendingCount };
+
+        atomic_fetch_add_explicit( currentPendingCount, 1u, std::memory_order_relaxed );
+
+        if( !PushWork( info, entry ) )
+        {
+            RunWork( info, entry );
+            return;
+        }
+
+        WakeWorker();
+    }
+
+    TaskHandle AddTask( WorkCallback* callback, void* data, TaskHandle* dependencies, s32 dependencyCount )
+    {
+        ASSERT( taskCount < MAX_TASK_COUNT );
+
+        TaskHandle result   = taskCount++;
+        Task* task          = &tasks[ result ];
+
+        task->callback          = callback;
+        task->data              = data;
+        task->dependencyCount   = dependencyCount;
+        task->dependentCount    = 0;
+        atomic_init( &task->remainingCount, ( u32 ) dependencyCount );
+
+        for( s32 i = 0; i < dependencyCount; ++i )
+        {
+            Task* dependency = &tasks[ dependencies[ i ] ];
+
+            ASSERT( dependencies[ i ] < result );
+            ASSERT( dependency->dependentCount < MAX_TASK_DEPENDENT_COUNT );
+
+            dependency->dependents[ dependency->dependentCount++ ] = result;
+        }
+
+        return result;
+    }
+
+    void RunTasks()
+    {
+        for( s32 i = 0; i < taskCount; ++i )
+        {
+            if( tasks[ i ].dependencyCount == 0 )
+                AddWorkQueueEntry( RunTask, &tasks[ i ] );
+        }
+
+        FinishWork();
+
+        taskCount = 0;
+    }
+
+    void ParallelFor( s32 count, s32 grain, ParallelForCallback* callback, void* data )
+    {
+        ParallelJob jobs[ MAX_PARALLEL_JOB_COUNT ];
+        s32 jobCount = SplitParallelJobs( count, grain, jobs );
+
+        for( s32 i = 0; i < jobCount; ++i )
+        {
+            jobs[ i ].callback  = callback;
+            jobs[ i ].data      = data;
+        }
+
+        if( jobCount > 0 )
+            RunParallelJobs( jobs, jobCount );
+    }
+
+    f64 ParallelReduce( s32 count, s32 grain, ParallelReduceCallback* callback, void* data )
+    {
+        ParallelJob jobs[ MAX_PARALLEL_JOB_COUNT ];
+        s32 jobCount = SplitParallelJobs( count, grain, jobs );
+
+        for( s32 i = 0; i < jobCount; ++i )
+        {
+            jobs[ i ].reduceCallback    = callback;
+            jobs[ i ].data              = data;
+        }
+
+        if( jobCount > 0 )
+            RunParallelJobs( jobs, jobCount );
+
+        f64 result = 0;
+        for( s32 i = 0; i < jobCount; ++i )
+            result += jobs[ i ].result;
+
+        return result;
+    }
+}
+
+namespace LinuxPlatform
+{
+    void StartWorkerThreads( Affinity affinity, Platform::NumaPolicy policy, s32 requestedThreadCount )
+    {
+        numaPolicy = policy;
+        GetSystemNodes();
+
+        CpuInfo* cpus   = 0;
+        s32 cpuCount    = affinity != Affinity_None ? GetCpus( affinity, &cpus ) : 0;
+
+        if( affinity != Affinity_None && cpuCount == 0 )
+            Platform::Log( "no cpu topology, the threads are not pinned\n" );
+
+        //pinned threads take the first cpus of the list, which fills one node before the next
+        threadCount = GetRequestedThreadCount( requestedThreadCount );
+        if( cpuCount > 0 )
+            threadCount = Utils::Min( threadCount, cpuCount );
+
+        threadInfo  = new ThreadInfo[ threadCount ];
+
+        //cpus are sorted by node, so the threads of a node are next to each other and steal from each other first
+        nodeCount = 1;
+        for( s32 i = 0; i < threadCount; ++i )
+        {
+            threadInfo[ i ].cpu     = cpuCount > 0 ? cpus[ i ].cpu : -1;
+            threadInfo[ i ].node    = 0;
+
+            if( cpuCount > 0 && i > 0 )
+            {
+                bool newNode            = cpus[ i ].node != cpus[ i - 1 ].node && nodeCount < MAX_NODE_COUNT;
+                nodeCount               += newNode ? 1 : 0;
+                threadInfo[ i ].node    = nodeCount - 1;
+            }
+
+            atomic_init( &threadInfo[ i ].top, 0ll );
+            atomic_init( &threadInfo[ i ].bottom, 0ll );
+            atomic_init( &threadInfo[ i ].pendingCount, 0u );
+        }
+
+        delete [] cpus;
+
+        threadInfo[ 0 ].threadIndex = 0;
+        threadInfo[ 0 ].threadId    = pthread_self();
+        currentThreadIndex          = 0;
+        currentPendingCount         = &threadInfo[ 0 ].pendingCount;
+
+        PinThread( &threadInfo[ 0 ] );
+
+        if( cpuCount > 0 )
+            Platform::Log( "%d threads pinned over %d NUMA nodes\n", threadCount, nodeCount );
+        else
+            Platform::Log( "%d threads\n", threadCount );
+
+        sem_init( &semaphore, 0, 0 );
+
+        for( s32 i = 1; i < threadCount; ++i )
+        {
+            threadInfo[ i ].threadIndex = i;
+
+            pthread_create( &threadInfo[ i ].threadId, NULL, ThreadProc, &threadInfo[ i ] );
+        }
+    }
+}
\ No newline at end of file
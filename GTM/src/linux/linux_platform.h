@@ -0,0 +1,27 @@
+#ifndef LINUX_PLATFORM_H
+#define LINUX_PLATFORM_H
+
+
+#include "../shared/types.h"
+#include "../shared/platform.h"
+
+
+namespace LinuxPlatform
+{
+    //Affinity_Cores pins one thread to each physical core, Affinity_Threads one to every hardware thread,
+    //both only over the cpus the process is allowed to run on; unpinned the pool has a thread per processor
+    enum Affinity
+    {
+        Affinity_None = 0,
+        Affinity_Cores,
+        Affinity_Threads
+    };
+
+    //threadCount 0 takes GTM_THREAD_COUNT from the environment when it is set, otherwise the cpus the process can
+    //use, its affinity mask cut down to any cgroup cpu quota; the block sizes of XMaths follow the same count
+    void StartWorkerThreads( Affinity affinity = Affinity_None, Platform::NumaPolicy numaPolicy = Platform::NumaPolicy_FirstTouch,
+                             s32 threadCount = 0 );
+}
+
+
+#endif
\ No newline at end of file
@@ -1,12 +1,10 @@
 #include "app.h"
+#include "gtm.h"
 #include "platform.h"
-#define UTILS_FUNCTIONS
 #include "utils.h"
 #include "xmaths.h"
 
 
-#include <stdio.h>
-#include <string.h>
 #include <math.h>
 
 
@@ -18,8 +16,6 @@
 
 namespace
 {
-    const s32 MAX_ITERATIONS = 10000;
-
     const f32 CIRCLE_RADIUS = 0.1f;
 
 
@@ -73,345 +69,6 @@ namespace
 
         return result;
     }
-
-
-    struct ResponsibilityData
-    {
-        s32 startIndex;
-        s32 endIndexPlus1;
-        f64 logSum;
-    };
-
-
-    s32 noBasisFunction;
-    s32 noLatVarSample;
-
-    s32 s;
-
-    s32 dataDimensions;
-    s32 latentDimensions;
-
-    s32 cycles;
-    f64* llh;
-
-    XMaths::Mf64 input;
-
-    XMaths::Mf64 FI, FI_T;
-
-    XMaths::Vf64 invColumnSum;
-
-    f64 beta;
-    XMaths::Mf64 output;
-
-    XMaths::Mf64 globalR, globalDIST;
-
-
-    void SetInitialOutput( XMaths::Mf64* X )
-    {
-        XMaths::Mf64 eigenVectors;
-        XMaths::Vf64 eigenValues;
-
-        XMaths::GetPrincipalComponents( &input, &eigenVectors, &eigenValues );
-
-        f64 latentDimEigenValue = eigenValues.v.base[ latentDimensions ];
-
-        s32 diff = eigenValues.count - latentDimensions;
-        eigenValues.count -= diff;
-
-        while( diff > 0 )
-        {
-            XMaths::DeleteLastColumn( &eigenVectors );
-            --diff;
-        }
-
-        XMaths::SqrtEquals( &eigenValues );
-        XMaths::Mf64 A = XMaths::MultiplyWithDiagonal( &eigenVectors, &eigenValues );
-
-        XMaths::Mf64 M = FI_T * FI;
-
-        XMaths::Mf64 W = XMaths::Invert( &M ) * FI_T * XMaths::MultiplyWithTranspose( X, &A );
-        XMaths::Vf64 meanColumns = XMaths::GetMeanColumns( &input );
-        XMaths::ReplaceRow( &W, W.rowCount - 1, &meanColumns );
-
-        output = FI * W;
-
-        s32 outputRowCount = output.rowCount;
-        XMaths::Mf64 interDist = XMaths::CreateMf64( outputRowCount, outputRowCount );
-        XMaths::Distance( &output, &output, &interDist );
-
-        for( s32 i = 0; i < outputRowCount; ++i )
-            interDist.m.base[ i * outputRowCount + i ] = 0x7fffffff;
-
-        XMaths::Vf64 minColumns = XMaths::GetMinColumns( &interDist );
-        beta = 2.0 / XMaths::GetMean( &minColumns );
-
-        if( latentDimensions < dataDimensions )
-            beta = fmin( beta, 1.0 / latentDimEigenValue );
-    }
-
-    void Setup()
-    {
-        invColumnSum = XMaths::CreateVf64( input.rowCount );
-
-        s32* count = new s32[ latentDimensions ];
-        for( s32 i = 0; i < latentDimensions; ++i )
-            count[ i ] = noLatVarSample;
-
-        s32 total = XMaths::ArrayProduct( count, latentDimensions );
-        XMaths::Mf64 X = XMaths::CreateMf64( total, latentDimensions );
-        XMaths::Grid( &X, count );
-
-        for( s32 i = 0; i < latentDimensions; ++i )
-            count[ i ] = noBasisFunction;
-
-        total = XMaths::ArrayProduct( count, latentDimensions );
-        XMaths::Mf64 MU = XMaths::CreateMf64( total, latentDimensions );
-        XMaths::Grid( &MU, count );
-
-        delete [] count;
-
-        f64 sigma = s * ( 2.0 / ( ( f64 ) noBasisFunction - 1.0 ) );
-
-        FI = XMaths::CreateMf64( X.rowCount, MU.rowCount + 1 );
-        XMaths::Distance( &MU, &X, &FI );
-        FI *= -1.0 / ( 2.0 * sigma * sigma );
-        XMaths::ExpEquals( &FI );
-
-        for( s32 i = 0; i < FI.rowCount; ++i )
-            FI.m.base[ i * FI.columnCount + ( FI.columnCount - 1 ) ] = 1;
-
-        FI_T = XMaths::GetTranspose( &FI );
-
-        SetInitialOutput( &X );
-
-        if( globalR.rowCount != FI.rowCount || globalR.columnCount != input.rowCount )
-        {
-            globalR = XMaths::CreateMf64( FI.rowCount, input.rowCount );
-            globalDIST = XMaths::CreateMf64( FI.rowCount, input.rowCount );
-        }
-        XMaths::Distance( &input, &output, &globalR );
-    }
-
-    void CalculateResponsibilities( s32 threadIndex, void* data )
-    {
-        ResponsibilityData* responsibilityData = ( ResponsibilityData* ) data;
-        s32 startIndex      = responsibilityData->startIndex;
-        s32 endIndexPlus1   = responsibilityData->endIndexPlus1;
-
-        f64 mul             = -beta / 2.0;
-
-        s32 RRowCount       = globalR.rowCount;
-        s32 RColumnCount    = globalR.columnCount;
-
-        f64* rArrayPtr          = globalR.m.base;
-        f64* rPtr               = rArrayPtr;
-        f64* invColumnSumPtr    = invColumnSum.v.base;
-
-        for( s32 i = startIndex; i < endIndexPlus1; ++i )
-        {
-            rPtr[ i ]               = exp( rPtr[ i ] * mul );
-            invColumnSumPtr[ i ]    = rPtr[ i ];
-        }
-
-        for( s32 i = 1; i < RRowCount - 1; ++i )
-        {
-            rPtr = &rArrayPtr[ i * RColumnCount ];
-            for( s32 j = startIndex; j < endIndexPlus1; ++j )
-            {
-                rPtr[ j ]               = exp( rPtr[ j ] * mul );
-                invColumnSumPtr[ j ]    += rPtr[ j ];
-            }
-        }
-
-        rPtr = &rArrayPtr[ ( RRowCount - 1 ) * RColumnCount ];
-        for( s32 i = startIndex; i < endIndexPlus1; ++i )
-        {
-            rPtr[ i ]                   = exp( rPtr[ i ] * mul );
-            invColumnSumPtr[ i ]        += rPtr[ i ];
-            responsibilityData->logSum  += log( invColumnSumPtr[ i ] );
-            invColumnSumPtr[ i ]        = 1.0 / invColumnSumPtr[ i ];
-        }
-
-        for( s32 i = 0; i < RRowCount; ++i )
-        {
-            rPtr = &rArrayPtr[ i * RColumnCount ];
-            for( s32 j = startIndex; j < endIndexPlus1; ++j )
-                rPtr[ j ] *= invColumnSumPtr[ j ];
-        }
-    }
-
-    void Train()
-    {
-        s32 RRowCount       = globalR.rowCount;
-        s32 RColumnCount    = globalR.columnCount;
-
-
-        s32 jobCount = Utils::Min( RColumnCount, Platform::GetProcessorCount() * 8 );
-        ResponsibilityData* data = new ResponsibilityData[ jobCount ];
-
-        s32 countPerJob = RColumnCount / jobCount;
-        for( s32 i = 0; i < jobCount - 1; ++i )
-        {
-            data[ i ] = { i * countPerJob, ( i + 1 ) * countPerJob, 0.0 };
-            Platform::AddWorkQueueEntry( CalculateResponsibilities, &data[ i ] );
-        }
-        data[ jobCount - 1 ] = { ( jobCount - 1 ) * countPerJob, RColumnCount, 0.0 };
-        Platform::AddWorkQueueEntry( CalculateResponsibilities, &data[ jobCount - 1 ] );
-
-        Platform::FinishWork();
-
-        f64 logSum = data[ 0 ].logSum;
-
-        for( s32 i = 1; i < jobCount; ++i )
-            logSum += data[ i ].logSum;
-
-        delete [] data;
-
-
-        llh[ cycles ] = ( input.columnCount / 2.0 ) * log( beta * INV_TAU ) - log( ( f64 ) noLatVarSample );
-        llh[ cycles ] = logSum + RColumnCount * llh[ cycles ];
-
-
-        XMaths::Vf64 rowSums = XMaths::SumRows( &globalR );
-        XMaths::Mf64 A = XMaths::MultiplyWithDiagonal( &FI_T, &rowSums ) * FI;
-        XMaths::Mf64 W = XMaths::Invert( &A ) * ( FI_T * ( globalR * input ) );
-
-        output = FI * W;
-
-
-        XMaths::Distance( &input, &output, &globalDIST );
-
-        f64 totalSum    = 0;
-        s32 count       = RRowCount * RColumnCount;
-
-        f64* rPtr       = globalR.m.base;
-        f64* dPtr       = globalDIST.m.base;
-
-        for( s32 i = 0; i < count; ++i )
-            totalSum += rPtr[ i ] * dPtr[ i ];
-
-        XMaths::Mf64 swap   = globalR;
-        globalR             = globalDIST;
-        globalDIST          = swap;
-
-        beta = ( f64 ) ( input.rowCount * input.columnCount ) / totalSum;
-    }
-
-
-    s32 inputCount;
-    s32 outputCount;
-
-
-    void Create2dData()
-    {
-        noLatVarSample      = 20;
-        latentDimensions    = 1;
-        noBasisFunction     = 5;
-        s                   = 2;
-        dataDimensions      = 2;
-
-        input               = XMaths::CreateMf64( 59, dataDimensions );
-        s32 index           = 0;
-        for( f32 x = 0.15f; x <= 3.05f; x += 0.05f )
-        {
-            input.m.base[ index++ ] = x;
-            input.m.base[ index++ ] = x + 1.25f * sin( 2.0f * x );
-        }
-    }
-
-    void LoadGTMData( char* filename )
-    {
-        FILE *file = fopen( filename, "rt" );
-
-        if( file == NULL )
-        {
-            LOG( "Could not load GTM data" );
-            return;
-        }
-
-        const s32 length = 256;
-        char aiName[ length ];
-        s32 aiVersion = 1;
-        fscanf( file, "%s %d", aiName, &aiVersion );
-        fscanf( file, "%d %d", &inputCount, &outputCount );
-        fscanf( file, "%d %d %d", &noBasisFunction, &noLatVarSample, &s );
-        fscanf( file, "%d %d", &latentDimensions, &dataDimensions );
-
-        s32 x;
-        s32 y;
-        fscanf( file, "%d %d", &x, &y );
-
-        input       = XMaths::CreateMf64( x, y );
-        s32 index   = 0;
-
-        for( s32 i = 0; i < x; ++i )
-        {
-            for( s32 j = 0; j < y; ++j )
-            {
-                f64 temp;
-                fscanf( file, "%lf", &temp );
-                input.m.base[ index++ ] = temp;
-            }
-        }
-
-        fclose( file );
-    }
-
-    void SaveGTM( char* filename )
-    {
-        FILE *file = fopen( filename, "wb" );
-        if( file == NULL )
-        {
-            LOG( "Could not save GTM" );
-            return;
-        }
-
-        const s32 length = 32;
-        char aiName[ length ];
-        sprintf( aiName, "GTM!" );
-        fwrite( aiName, length * sizeof( char ), 1, file );
-        s32 aiVersion = 3;
-        fwrite( &aiVersion, sizeof( s32 ), 1, file );
-
-        fwrite( &inputCount, sizeof( s32 ), 1, file );
-        fwrite( &outputCount, sizeof( s32 ), 1, file );
-
-        fwrite( &noBasisFunction, sizeof( s32 ), 1, file );
-        fwrite( &noLatVarSample, sizeof( s32 ), 1, file );
-        fwrite( &s, sizeof( s32 ), 1, file );
-
-        fwrite( &latentDimensions, sizeof( s32 ), 1, file );
-        fwrite( &dataDimensions, sizeof( s32 ), 1, file );
-
-        for( s32 i = 0; i < output.rowCount * output.columnCount; ++i )
-            fwrite( &output.m.base[ i ], sizeof( f64 ), 1, file );
-
-        fclose( file );
-    }
-
-    void SaveLLH( char* filename, f32 time )
-    {
-        FILE *file = fopen( filename, "wt" );
-        if( file == NULL )
-        {
-            LOG( "Could not save LLH" );
-            return;
-        }
-
-        const s32 length = 256;
-        char outputString[ length ];
-
-        for( s32 i = 0; i < cycles; ++i )
-        {
-            sprintf( outputString, "%f\n", llh[ i ] );
-            fwrite( outputString, strlen( outputString ) * sizeof( char ), 1, file );
-        }
-
-        sprintf( outputString, "time: %fms", time * 1000.0f );
-        fwrite( outputString, strlen( outputString ) * sizeof( char ), 1, file );
-
-        fclose( file );
-    }
 }
 
 namespace App
@@ -436,17 +93,12 @@ namespace App
         Resize( width, height );
 
 
-        llh = new f64[ MAX_ITERATIONS ];
-
-
         f32 loadTime;
         {
             TIMED_BLOCK( &loadTime );
-            Create2dData();
+            GTM::Create2dData();
 
-            ASSERT( dataDimensions >= latentDimensions );
-            ASSERT( latentDimensions <= 3 );
-            ASSERT( s > 0 );
+            ASSERT( GTM::ValidateParameters() );
         }
         LOG( "load time: %fms\n", loadTime * 1000.0f );
 
@@ -454,7 +106,7 @@ namespace App
         f32 setupTime;
         {
             TIMED_BLOCK( &setupTime );
-            Setup();
+            GTM::Setup();
         }
         LOG( "setup time: %fms\n", setupTime * 1000.0f );
 
@@ -462,52 +114,32 @@ namespace App
         f32 trainingTime;
         {
             TIMED_BLOCK( &trainingTime );
-            cycles = 0;
-
-            while( cycles <= 1 || fabs( llh[ cycles - 1 ] - llh[ cycles - 2 ] ) > 0.01f )
-            {
-                f32 cycleTime;
-                {
-                    TIMED_BLOCK( &cycleTime );
-                    Train();
-                }
-
-                ++cycles;
-                LOG( "cycles: %d, time: %fms\n", cycles, cycleTime * 1000.0f );
-
-                if( cycles >= MAX_ITERATIONS )
-                    break;
-            }
+            GTM::TrainUntilConverged();
         }
         LOG( "training time: %fms\n", trainingTime * 1000.0f );
         LOG( "total time: %fms\n", ( loadTime + setupTime + trainingTime ) * 1000.0f );
 
 
-        const s32 length = 128;
-        char filename[ length ];
-        
-        sprintf( filename, "gtm_llh_%d^%d_%d_%d.nn", noLatVarSample, latentDimensions, noBasisFunction, s );
-        SaveLLH( filename, loadTime + setupTime + trainingTime );
+        GTM::SaveResults( NULL, loadTime + setupTime + trainingTime );
 
-        sprintf( filename, "gtm_%d^%d_%d_%d.nn", noLatVarSample, latentDimensions, noBasisFunction, s );
-        SaveGTM( filename );
 
+        XMaths::Mf64* input = GTM::GetInput();
 
         windowRect.left     = F32_MAX;
         windowRect.right    = F32_MIN;
         windowRect.top      = F32_MIN;
         windowRect.bottom   = F32_MAX;
 
-        f64* iPtr = input.m.base;
+        f64* iPtr = input->m.base;
 
         f32 margin = CIRCLE_RADIUS * 2;
-        for( s32 i = 0; i < input.rowCount; ++i )
+        for( s32 i = 0; i < input->rowCount; ++i )
         {
-            f32 x               = ( f32 ) iPtr[ i * input.columnCount ];
+            f32 x               = ( f32 ) iPtr[ i * input->rowStride ];
             windowRect.left     = fminf( windowRect.left, x - margin );
             windowRect.right    = fmaxf( windowRect.right, x + margin );
 
-            f32 y               = ( f32 ) iPtr[ i * input.columnCount + 1 ];
+            f32 y               = ( f32 ) iPtr[ i * input->rowStride + 1 ];
             windowRect.top      = fmaxf( windowRect.top, y + margin );
             windowRect.bottom   = fminf( windowRect.bottom, y - margin );
         }
@@ -521,8 +153,12 @@ namespace App
 
     void Render()
     {
-        f64* iPtr = input.m.base;
-        f64* oPtr = output.m.base;
+        XMaths::Mf64* input     = GTM::GetInput();
+        XMaths::Mf64* output    = GTM::GetOutput();
+        f64 beta                = GTM::GetBeta();
+
+        f64* iPtr = input->m.base;
+        f64* oPtr = output->m.base;
 
         glMatrixMode( GL_PROJECTION );
         glLoadIdentity();
@@ -538,16 +174,16 @@ namespace App
 
         glColor3f( 1.0f, 0.0f, 0.0f );
 
-        for( s32 i = 0; i < input.rowCount; ++i )
-            Circle( ( f32 ) iPtr[ i * input.columnCount ], ( f32 ) iPtr[ i * input.columnCount + 1 ], CIRCLE_RADIUS );
+        for( s32 i = 0; i < input->rowCount; ++i )
+            Circle( ( f32 ) iPtr[ i * input->rowStride ], ( f32 ) iPtr[ i * input->rowStride + 1 ], CIRCLE_RADIUS );
 
 
         glColor3f( 0.0f, 1.0f, 0.0f );
 
         glBegin( GL_LINE_STRIP );
 
-        for( s32 i = 0; i < output.rowCount; ++i )
-            glVertex2f( ( f32 ) oPtr[ i * output.columnCount ], ( f32 ) oPtr[ i * output.columnCount + 1 ] );
+        for( s32 i = 0; i < output->rowCount; ++i )
+            glVertex2f( ( f32 ) oPtr[ i * output->rowStride ], ( f32 ) oPtr[ i * output->rowStride + 1 ] );
 
         glEnd();
 
@@ -556,14 +192,14 @@ namespace App
 
         glBegin( GL_POINTS );
 
-        for( s32 i = 0; i < output.rowCount; ++i )
-            glVertex2f( ( f32 ) oPtr[ i * output.columnCount ], ( f32 ) oPtr[ i * output.columnCount + 1 ] );
+        for( s32 i = 0; i < output->rowCount; ++i )
+            glVertex2f( ( f32 ) oPtr[ i * output->rowStride ], ( f32 ) oPtr[ i * output->rowStride + 1 ] );
 
         glEnd();
 
 
         f32 radius = sqrtf( 1.0f / ( f32 ) beta );
-        for( s32 i = 0; i < output.rowCount; ++i )
-            Circle( ( f32 ) oPtr[ i * output.columnCount ], ( f32 ) oPtr[ i * output.columnCount + 1 ], radius );
+        for( s32 i = 0; i < output->rowCount; ++i )
+            Circle( ( f32 ) oPtr[ i * output->rowStride ], ( f32 ) oPtr[ i * output->rowStride + 1 ], radius );
     }
 }
\ No newline at end of file
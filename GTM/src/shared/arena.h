@@ -0,0 +1,165 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+
+#include "types.h"
+#include "utils.h"
+
+
+//linear allocator for working memory: Push hands out memory from cache line aligned blocks and Reset or PopToMark
+//give it back all at once; every push starts on its own cache line and takes whole lines, so pushes never share a
+//line and the same pushes always take the same space; a push that does not fit chains on another block, and once
+//the arena empties those blocks are dropped so the next push takes one block the size of the high water mark,
+//so a workload that repeats settles into a single block and stops allocating; only used from one thread at a time
+struct ArenaBlock
+{
+    u8* base;
+    s64 size;
+    s64 used;
+
+    ArenaBlock* previous;
+};
+
+struct ArenaMark
+{
+    ArenaBlock* block;
+    s64 used;
+};
+
+struct Arena
+{
+    static const s64 MINIMUM_BLOCK_SIZE = 64 * 1024;
+
+    ArenaBlock* block;
+    //over every block
+    s64 used;
+    s64 highWaterMark;
+
+    Arena()
+    {
+        block           = 0;
+        used            = 0;
+        highWaterMark   = 0;
+    }
+
+    ~Arena()
+    {
+        FreeBlocks( 0 );
+    }
+
+    void* Push( s64 size )
+    {
+        ASSERT( size >= 0 );
+
+        size = ( size + CACHE_LINE_SIZE - 1 ) & ~( s64 ) ( CACHE_LINE_SIZE - 1 );
+
+        if( !block || block->used + size > block->size )
+        {
+            s64 blockSize = size > highWaterMark ? size : highWaterMark;
+            blockSize = blockSize > MINIMUM_BLOCK_SIZE ? blockSize : MINIMUM_BLOCK_SIZE;
+
+            ArenaBlock* newBlock    = new ArenaBlock();
+            newBlock->base          = ( u8* ) ALIGNED_ALLOC( blockSize, CACHE_LINE_SIZE );
+            newBlock->size          = blockSize;
+            newBlock->used          = 0;
+            newBlock->previous      = block;
+
+            block = newBlock;
+        }
+
+        void* result    = block->base + block->used;
+        block->used     += size;
+        used            += size;
+        highWaterMark   = used > highWaterMark ? used : highWaterMark;
+
+        ASSERT_ALIGNED_TO_CACHE( result );
+        return result;
+    }
+
+    template< typename T >
+    T* Push( s32 count )
+    {
+        T* result = ( T* ) Push( sizeof( T ) * ( s64 ) count );
+        return result;
+    }
+
+    ArenaMark GetMark()
+    {
+        ArenaMark result = { block, block ? block->used : 0 };
+        return result;
+    }
+
+    void PopToMark( ArenaMark mark )
+    {
+        if( mark.block )
+        {
+            FreeBlocks( mark.block );
+
+            used        -= block->used - mark.used;
+            block->used = mark.used;
+        }
+
+        if( !mark.block || used == 0 )
+            Reset();
+    }
+
+    //keeps the first block, unless it is smaller than the high water mark, in which case it goes as well
+    //and the next push takes one block that covers the mark
+    void Reset()
+    {
+        ArenaBlock* first = block;
+        while( first && first->previous )
+            first = first->previous;
+
+        if( first && first->size < highWaterMark )
+            first = 0;
+
+        FreeBlocks( first );
+
+        if( block )
+        {
+            used        -= block->used;
+            block->used = 0;
+        }
+
+        ASSERT( used == 0 );
+    }
+
+    //frees the blocks pushed after last, all of them when last is NULL
+    void FreeBlocks( ArenaBlock* last )
+    {
+        while( block && block != last )
+        {
+            ArenaBlock* previous = block->previous;
+
+            used -= block->used;
+            ALIGNED_FREE( block->base );
+            delete block;
+
+            block = previous;
+        }
+    }
+};
+
+
+//gives back everything pushed onto arena in the enclosing scope when it ends
+struct TemporaryMemory
+{
+    Arena* arena;
+    ArenaMark mark;
+
+    TemporaryMemory( Arena* arena )
+    {
+        this->arena = arena;
+        mark        = arena->GetMark();
+    }
+
+    ~TemporaryMemory()
+    {
+        arena->PopToMark( mark );
+    }
+};
+#define TEMPORARY_MEMORY( arena ) TemporaryMemory temporaryMemory( arena )
+
+
+#endif
\ No newline at end of file
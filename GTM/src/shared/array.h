@@ -2,87 +2,168 @@
 #define ARRAY_H
 
 
+#include <atomic>
+#include <new>
+
+#include "arena.h"
 #include "types.h"
 #include "utils.h"
 
 
+enum ArrayOptions
+{
+    ArrayOptions_None   = 0,
+    //the use count changes with atomic read modify writes, so copies of one array can be made and dropped on
+    //several threads at once; otherwise only one thread at a time may copy or drop copies of it
+    ArrayOptions_Atomic = 1 << 0
+};
+
+//sits in front of the elements in the same allocation, padded out to the alignment so the elements keep it
+struct ArrayHeader
+{
+    std::atomic< s32 > useCount;
+    u32 options;
+};
+
+
+//a reference counted run of elements: copies share the elements and the last one to go frees them,
+//moves hand them over without touching the count
 template< typename T >
 struct Array
 {
     s32 count;
     T* base;
 
-    s32* useCount;
+    ArrayHeader* header;
 
     Array()
     {
         count       = 0;
         base        = 0;
 
-        useCount    = 0;
+        header      = 0;
     }
 
-    Array( s32 count, s32 alignment = sizeof( s32 ) )
+    Array( s32 count, s32 alignment = sizeof( s32 ), u32 options = ArrayOptions_None )
     {
         this->count = count;
-        base        = ( T* ) ALIGNED_ALLOC( sizeof( T ) * count, alignment );
-        ASSERT_ALIGNED_TO( base, alignment );
 
-        useCount    = new s32();
-        *useCount   = 1;
+        s64 size    = sizeof( T ) * ( s64 ) count;
+
+        if( alignment < ( s32 ) sizeof( ArrayHeader ) )
+            alignment = sizeof( ArrayHeader );
+
+        s64 headerSize      = ( ( sizeof( ArrayHeader ) + alignment - 1 ) / alignment ) * alignment;
+        s64 blockSize       = ( ( headerSize + size + alignment - 1 ) / alignment ) * alignment;
+        u8* block           = ( u8* ) ALIGNED_ALLOC( blockSize, alignment );
+        ASSERT_ALIGNED_TO( block, alignment );
+
+        header              = new( block ) ArrayHeader();
+        header->useCount.store( 1, std::memory_order_relaxed );
+        header->options     = options;
+
+        base                = ( T* ) ( block + headerSize );
+        Platform::PlaceMemory( base, size );
+    }
+
+    //memory from an arena is cache line aligned and not counted or freed here, it goes back when the arena is reset or popped
+    Array( s32 count, Arena* arena )
+    {
+        this->count = count;
+        base        = arena->Push< T >( count );
+
+        header      = 0;
     }
 
     Array( const Array &c )
     {
-        count       = c.count;
-        base        = c.base;
+        Copy( c );
+    }
 
-        useCount    = c.useCount;
-        ++( *useCount );
+    Array( Array &&c )
+    {
+        Move( &c );
     }
 
     ~Array()
     {
-        count = 0;
+        Release();
+    }
 
-        if( useCount )
+    Array& operator = ( const Array &c )
+    {
+        if( this != &c )
         {
-            --( *useCount );
-            if( *useCount == 0 )
-            {
-                ALIGNED_FREE( base );
-
-                delete useCount;
-            }
-            
-            useCount = 0;
+            Release();
+            Copy( c );
         }
-        
-        base = 0;
+
+        return *this;
     }
 
-    Array& operator = ( const Array &c )
+    Array& operator = ( Array &&c )
     {
-        if( useCount )
+        if( this != &c )
         {
-            --( *useCount );
-            if( *useCount == 0 )
-            {
-                ALIGNED_FREE( base );
-
-                delete useCount;
-            }
-            
-            useCount = 0;
+            Release();
+            Move( &c );
         }
 
+        return *this;
+    }
+
+    void Copy( const Array &c )
+    {
         count       = c.count;
         base        = c.base;
 
-        useCount    = c.useCount;
-        ++( *useCount );
+        header      = c.header;
+        if( header )
+        {
+            if( header->options & ArrayOptions_Atomic )
+                header->useCount.fetch_add( 1, std::memory_order_relaxed );
+            else
+                header->useCount.store( header->useCount.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+        }
+    }
 
-        return *this;
+    void Move( Array* c )
+    {
+        count       = c->count;
+        base        = c->base;
+        header      = c->header;
+
+        c->count    = 0;
+        c->base     = 0;
+        c->header   = 0;
+    }
+
+    void Release()
+    {
+        if( header )
+        {
+            s32 useCount;
+            if( header->options & ArrayOptions_Atomic )
+            {
+                useCount = header->useCount.fetch_sub( 1, std::memory_order_acq_rel ) - 1;
+            }
+            else
+            {
+                useCount = header->useCount.load( std::memory_order_relaxed ) - 1;
+                header->useCount.store( useCount, std::memory_order_relaxed );
+            }
+
+            if( useCount == 0 )
+            {
+                header->~ArrayHeader();
+                ALIGNED_FREE( header );
+            }
+
+            header = 0;
+        }
+
+        count   = 0;
+        base    = 0;
     }
 };
 
@@ -0,0 +1,940 @@
+#include "gtm.h"
+#include "platform.h"
+#include "utils.h"
+
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+
+#define TAU     6.28318530f
+#define INV_TAU 1.0f / TAU
+
+
+namespace
+{
+    //the e step runs over tiles of data points sized so a tile of responsibilities stays in L2,
+    //responsibilities only ever exist a tile at a time so memory does not grow with the data point count
+    const s32 RESPONSIBILITY_TILE_BYTES     = 128 * 1024;
+    const s32 RESPONSIBILITY_TILE_MAX_COUNT = 256;
+
+    //the data points are split into this many e step jobs per thread, a second one lets stealing even out a thread
+    //that falls behind; each job has its own m step sums, so they grow with it
+    const s32 RESPONSIBILITY_JOBS_PER_THREAD = 2;
+
+
+    //what the e step reads and writes in one precision, the f32 copies of input and output are centred on the
+    //input mean so the f32 gemm distances keep their precision; threadProducts holds each f32 tile's R * input
+    //before it is added into the f64 sums
+    template< typename T >
+    struct EStep
+    {
+        XMaths::Matrix< T > input;
+        XMaths::Vector< T > inputSquaredNorms;
+        XMaths::Matrix< T > output;
+        XMaths::Vector< T > outputSquaredNorms;
+
+        XMaths::Matrix< T >* threadTiles;
+        XMaths::Matrix< T >* threadProducts;
+    };
+
+
+    s32 noBasisFunction;
+    s32 noLatVarSample;
+
+    s32 s;
+
+    s32 dataDimensions;
+    s32 latentDimensions;
+
+    s32 cycles;
+    f64* llh;
+
+    XMaths::Mf64 input;
+    XMaths::Vf64 inputMean;
+    f64 inputScatter;
+
+    XMaths::Mf64 FI;
+
+    f64 beta;
+    XMaths::Mf64 output;
+
+#ifdef GTM_F32
+    GTM::Precision precision = GTM::Precision_F32;
+#else
+    GTM::Precision precision = GTM::Precision_F64;
+#endif
+
+    //see GTM::SetPruning, 0 for the exact e step
+    f64 pruning;
+
+    EStep< f64 > eStepF64;
+    EStep< f32 > eStepF32;
+
+    //the pruned e step's index over the f64 output and, per thread, room for one data point's sparse
+    //responsibilities, the latent points it keeps and their weights
+    XMaths::KDTree outputTree;
+    Array< s32 > threadNeighbours;
+    XMaths::Mf64 threadNeighbourWeights;
+
+    //tiles are tileCount data points wide; per e step job, over a fixed range of the data points, the f64 m step
+    //sums R * input and the row sums of R, added up in job order so they only depend on the processor count and
+    //not on which thread ran or stole each job
+    s32 tileCount;
+    s32 jobCount;
+    XMaths::Mf64* jobRT;
+    XMaths::Mf64 jobRowSums;
+
+    //everything a training cycle needs only for that cycle, reset at the start of each one
+    Arena cycleArena;
+
+
+    s32 inputCount;
+    s32 outputCount;
+
+
+    void SetInitialOutput( XMaths::Mf64* X )
+    {
+        XMaths::Mf64 eigenVectors;
+        XMaths::Vf64 eigenValues;
+
+        //one past the latent dimensions, whose eigenvalue caps beta below
+        s32 componentCount = Utils::Min( latentDimensions + 1, dataDimensions );
+        XMaths::GetPrincipalComponents( &input, componentCount, &eigenVectors, &eigenValues );
+
+        f64 latentDimEigenValue = latentDimensions < dataDimensions ? eigenValues.v.base[ latentDimensions ] : 0;
+
+        eigenValues.count = latentDimensions;
+        XMaths::SqrtEquals( &eigenValues );
+
+        //X * ( E * diag( sqrt( eigenvalues ) ) )^T over the leading eigenvectors, read in place from the first columns
+        XMaths::Mf64View leading = XMaths::View( &eigenVectors, 0, eigenVectors.rowCount, 0, latentDimensions );
+        XMaths::Mf64 XA = {};
+        XMaths::Evaluate( &XA, XMaths::Lazy( X ) * XMaths::Diagonal( &eigenValues ) * XMaths::Transposed( leading ) );
+
+        XMaths::Mf64 M = {};
+        XMaths::WeightedGram( &FI, 0, &M );
+
+        XMaths::Mf64 B = {};
+        XMaths::Evaluate( &B, XMaths::Transposed( &FI ) * XA );
+        XMaths::Mf64 W = XMaths::SolveSymmetric( &M, &B );
+        XMaths::Vf64 meanColumns = XMaths::GetMeanColumns( &input );
+        XMaths::ReplaceRow( &W, W.rowCount - 1, &meanColumns );
+
+        output = FI * W;
+
+        //from the mean squared distance between each centre and its nearest other one
+        XMaths::KDTree tree = {};
+        XMaths::BuildKDTree( &output, &tree );
+
+        XMaths::Vf64 nearest = {};
+        XMaths::GetNearestSquaredDistances( &tree, &nearest );
+        beta = 2.0 / XMaths::GetMean( &nearest );
+
+        if( latentDimensions < dataDimensions )
+            beta = fmin( beta, 1.0 / latentDimEigenValue );
+    }
+
+    void AccumulateTile( s32 threadIndex, s32 job, XMaths::Mf64* tile, s32 count, s32 tileStart, EStep< f64 >* eStep )
+    {
+        XMaths::MultiplyAccumulateRange( threadIndex, XMaths::View( tile, 0, tile->rowCount, 0, count ),
+                                         XMaths::View( &eStep->input, tileStart, count, 0, eStep->input.columnCount ), &jobRT[ job ] );
+    }
+
+    //each f32 tile is multiplied on its own and added into the f64 sums, so f32 rounding never builds up over the data
+    void AccumulateTile( s32 threadIndex, s32 job, XMaths::Mf32* tile, s32 count, s32 tileStart, EStep< f32 >* eStep )
+    {
+        XMaths::Mf32* product   = &eStep->threadProducts[ threadIndex ];
+        XMaths::Mf64* RT        = &jobRT[ job ];
+
+        memset( product->m.base, 0, sizeof( f32 ) * product->rowCount * product->rowStride );
+        XMaths::MultiplyAccumulateRange( threadIndex, XMaths::View( tile, 0, tile->rowCount, 0, count ),
+                                         XMaths::View( &eStep->input, tileStart, count, 0, eStep->input.columnCount ), product );
+
+        for( s32 i = 0; i < product->rowCount; ++i )
+        {
+            f32* pPtr   = &product->m.base[ i * product->rowStride ];
+            f64* rtPtr  = &RT->m.base[ i * RT->rowStride ];
+
+            for( s32 j = 0; j < product->columnCount; ++j )
+                rtPtr[ j ] += pPtr[ j ];
+        }
+    }
+
+    //the data points of an e step job, split evenly in job order
+    void GetJobRange( s32 job, s32* startIndex, s32* endIndexPlus1 )
+    {
+        *startIndex     = ( s32 ) ( ( s64 ) input.rowCount * job / jobCount );
+        *endIndexPlus1  = ( s32 ) ( ( s64 ) input.rowCount * ( job + 1 ) / jobCount );
+    }
+
+    //distance, exp( -beta / 2 * d ) and normalisation for one tile of data points at a time, so the distances
+    //never leave the cache; each column is shifted by its smallest distance first so it can never sum to zero,
+    //then the tile is folded into the job's sums for the m step and dropped
+    template< typename T >
+    f64 CalculateResponsibilities( s32 threadIndex, s32 job, EStep< T >* eStep )
+    {
+        s32 startIndex;
+        s32 endIndexPlus1;
+        GetJobRange( job, &startIndex, &endIndexPlus1 );
+
+        f64 mul             = -beta / 2.0;
+
+        s32 RRowCount       = output.rowCount;
+
+        XMaths::Matrix< T >* tileR  = &eStep->threadTiles[ threadIndex ];
+        T* tile                     = tileR->m.base;
+        s32 tileStride              = tileR->rowStride;
+        f64* rowSumsPtr             = &jobRowSums.m.base[ job * jobRowSums.rowStride ];
+
+        T columnMin[ RESPONSIBILITY_TILE_MAX_COUNT ];
+        T columnSum[ RESPONSIBILITY_TILE_MAX_COUNT ];
+
+        f64 logSum = 0;
+
+        for( s32 tileStart = startIndex; tileStart < endIndexPlus1; tileStart += tileCount )
+        {
+            s32 count = Utils::Min( tileCount, endIndexPlus1 - tileStart );
+
+            XMaths::DistanceRange( threadIndex, &eStep->input, tileStart, tileStart + count, &eStep->output, tile, tileStride,
+                                   &eStep->inputSquaredNorms, &eStep->outputSquaredNorms );
+
+            for( s32 j = 0; j < count; ++j )
+                columnMin[ j ] = tile[ j ];
+
+            for( s32 i = 1; i < RRowCount; ++i )
+            {
+                T* rPtr = &tile[ i * tileStride ];
+                for( s32 j = 0; j < count; ++j )
+                    columnMin[ j ] = rPtr[ j ] < columnMin[ j ] ? rPtr[ j ] : columnMin[ j ];
+            }
+
+            for( s32 i = 0; i < RRowCount; ++i )
+            {
+                T* rPtr = &tile[ i * tileStride ];
+                for( s32 j = 0; j < count; ++j )
+                    rPtr[ j ] -= columnMin[ j ];
+
+                XMaths::Exp( rPtr, rPtr, count, ( T ) mul );
+
+                if( i == 0 )
+                {
+                    for( s32 j = 0; j < count; ++j )
+                        columnSum[ j ] = rPtr[ j ];
+                }
+                else
+                {
+                    for( s32 j = 0; j < count; ++j )
+                        columnSum[ j ] += rPtr[ j ];
+                }
+            }
+
+            logSum += XMaths::SumLog( columnSum, count );
+
+            for( s32 j = 0; j < count; ++j )
+            {
+                logSum          += mul * columnMin[ j ];
+                columnSum[ j ]  = 1 / columnSum[ j ];
+            }
+
+            for( s32 i = 0; i < RRowCount; ++i )
+            {
+                T* rPtr = &tile[ i * tileStride ];
+                f64 sum = 0;
+
+                for( s32 j = 0; j < count; ++j )
+                {
+                    rPtr[ j ]   *= columnSum[ j ];
+                    sum         += rPtr[ j ];
+                }
+
+                rowSumsPtr[ i ] += sum;
+            }
+
+            AccumulateTile( threadIndex, job, tileR, count, tileStart, eStep );
+        }
+
+        return logSum;
+    }
+
+    //e step jobs [ startIndex, endIndexPlus1 ), their log sums added in job order
+    template< typename T >
+    f64 CalculateResponsibilityJobs( s32 threadIndex, s32 startIndex, s32 endIndexPlus1, void* data )
+    {
+        f64 result = 0;
+        for( s32 job = startIndex; job < endIndexPlus1; ++job )
+            result += CalculateResponsibilities( threadIndex, job, ( EStep< T >* ) data );
+
+        return result;
+    }
+
+    //queues the e step over every data point and returns the summed log of the unnormalised column sums
+    template< typename T >
+    f64 CalculateResponsibilities( EStep< T >* eStep )
+    {
+        f64 result = Platform::ParallelReduce( jobCount, 1, CalculateResponsibilityJobs< T >, eStep );
+        return result;
+    }
+
+    //the e step one data point at a time over only the latent points within cutoff of its nearest, each point's
+    //responsibilities are held sparse as those latent points and their weights and folded into the job's m step
+    //sums straight away; past the cutoff exp( -beta / 2 * ( d - dMin ) ) is under pruning / ( K * N ), so the at most
+    //K left out add less than pruning / N to a column sum of at least 1 and take less than that off its log; the bound
+    //holds for this e step at this output and beta, the m step then moves on from the pruned sums
+    f64 CalculatePrunedResponsibilities( s32 threadIndex, s32 job, EStep< f64 >* eStep )
+    {
+        s32 startIndex;
+        s32 endIndexPlus1;
+        GetJobRange( job, &startIndex, &endIndexPlus1 );
+
+        f64 mul             = -beta / 2.0;
+        f64 cutoff          = fmax( log( ( f64 ) output.rowCount * input.rowCount / pruning ), 0.0 ) * 2.0 / beta;
+
+        s32 rowStride       = eStep->input.rowStride;
+        f64* iArrayPtr      = eStep->input.m.base;
+        f64* rtArrayPtr     = jobRT[ job ].m.base;
+        f64* rowSumsPtr     = &jobRowSums.m.base[ job * jobRowSums.rowStride ];
+        s32* neighbours     = &threadNeighbours.base[ threadIndex * threadNeighbourWeights.rowStride ];
+        f64* weights        = &threadNeighbourWeights.m.base[ threadIndex * threadNeighbourWeights.rowStride ];
+
+        f64 logSum = 0;
+
+        for( s32 i = startIndex; i < endIndexPlus1; ++i )
+        {
+            f64* iPtr = &iArrayPtr[ i * rowStride ];
+
+            f64 minDistance;
+            XMaths::GetNearest( &outputTree, iPtr, -1, &minDistance, true );
+            s32 count = XMaths::GetWithin( &outputTree, iPtr, minDistance + cutoff, neighbours, weights, true );
+
+            for( s32 k = 0; k < count; ++k )
+                weights[ k ] -= minDistance;
+
+            XMaths::Exp( weights, weights, count, mul );
+
+            f64 sum = 0;
+            for( s32 k = 0; k < count; ++k )
+                sum += weights[ k ];
+
+            logSum      += log( sum ) + mul * minDistance;
+            f64 invSum  = 1 / sum;
+
+            //jobRT has input's shape, so its stride, and the zero padding of both rows stays zero
+            for( s32 k = 0; k < count; ++k )
+            {
+                f64 r       = weights[ k ] * invSum;
+                f64* rtPtr  = &rtArrayPtr[ neighbours[ k ] * rowStride ];
+
+                rowSumsPtr[ neighbours[ k ] ] += r;
+                for( s32 j = 0; j < rowStride; ++j )
+                    rtPtr[ j ] += r * iPtr[ j ];
+            }
+        }
+
+        return logSum;
+    }
+
+    //pruned e step jobs [ startIndex, endIndexPlus1 ), their log sums added in job order
+    f64 CalculatePrunedResponsibilityJobs( s32 threadIndex, s32 startIndex, s32 endIndexPlus1, void* data )
+    {
+        f64 result = 0;
+        for( s32 job = startIndex; job < endIndexPlus1; ++job )
+            result += CalculatePrunedResponsibilities( threadIndex, job, ( EStep< f64 >* ) data );
+
+        return result;
+    }
+
+    f64 CalculatePrunedResponsibilities()
+    {
+        f64 result = Platform::ParallelReduce( jobCount, 1, CalculatePrunedResponsibilityJobs, &eStepF64 );
+        return result;
+    }
+
+    //the pruned e step always runs in f64
+    bool IsF32EStep()
+    {
+        return precision == GTM::Precision_F32 && pruning == 0;
+    }
+
+    template< typename T >
+    void CreateThreadTiles( EStep< T >* eStep, s32 processorCount, s32 RRowCount )
+    {
+        delete [] eStep->threadTiles;
+        eStep->threadTiles = new XMaths::Matrix< T >[ processorCount ];
+
+        s32 tileStride = XMaths::GetRowStride< T >( tileCount );
+
+        for( s32 i = 0; i < processorCount; ++i )
+            eStep->threadTiles[ i ] = { RRowCount, tileCount, tileStride, Array< T >( RRowCount * tileStride, CACHE_LINE_SIZE ) };
+    }
+
+    void SetEStepOutput()
+    {
+        if( IsF32EStep() )
+        {
+            XMaths::Convert( &output, &inputMean, &eStepF32.output );
+            XMaths::GetSquaredRowNorms( &eStepF32.output, &eStepF32.outputSquaredNorms );
+        }
+        else if( pruning > 0 )
+        {
+            eStepF64.output = output;
+            XMaths::BuildKDTree( &eStepF64.output, &outputTree );
+        }
+        else
+        {
+            eStepF64.output = output;
+            XMaths::GetSquaredRowNorms( &output, &eStepF64.outputSquaredNorms );
+        }
+    }
+
+    struct WeightedDistanceData
+    {
+        XMaths::Mf64* RT;
+        XMaths::Vf64* rowSums;
+    };
+
+    //rows [ startIndex, endIndexPlus1 ) of GetWeightedDistanceSum
+    f64 WeightedDistanceBlock( s32 threadIndex, s32 startIndex, s32 endIndexPlus1, void* data )
+    {
+        WeightedDistanceData* weightedDistanceData = ( WeightedDistanceData* ) data;
+
+        s32 columnCount     = output.columnCount;
+        s32 oRowStride      = output.rowStride;
+        s32 rtRowStride     = weightedDistanceData->RT->rowStride;
+
+        f64* oPtr           = &output.m.base[ startIndex * oRowStride ];
+        f64* rtPtr          = &weightedDistanceData->RT->m.base[ startIndex * rtRowStride ];
+        f64* rowSumsPtr     = weightedDistanceData->rowSums->v.base;
+        f64* meanPtr        = inputMean.v.base;
+
+        f64 result = 0;
+
+        for( s32 i = startIndex; i < endIndexPlus1; ++i, oPtr += oRowStride, rtPtr += rtRowStride )
+        {
+            f64 g = rowSumsPtr[ i ];
+
+            f64 outputSum   = 0;
+            f64 crossSum    = 0;
+            for( s32 j = 0; j < columnCount; ++j )
+            {
+                f64 o       = oPtr[ j ] - meanPtr[ j ];
+                outputSum   += o * o;
+                crossSum    += o * ( rtPtr[ j ] - g * meanPtr[ j ] );
+            }
+
+            result += g * outputSum - 2.0 * crossSum;
+        }
+
+        return result;
+    }
+
+    //sum over every point and latent point of R[ k ][ n ] * |output[ k ] - input[ n ]|^2, expanded around the input
+    //mean into the responsibility weighted sums the m step already has, RT = R * input and rowSums, so the distances
+    //to the new output never need a pass over the data; centring keeps the cancellation down to the scale of the fit
+    f64 GetWeightedDistanceSum( XMaths::Mf64* RT, XMaths::Vf64* rowSums )
+    {
+        WeightedDistanceData data = { RT, rowSums };
+
+        s32 grain   = Platform::GetGrain( 4 * output.columnCount );
+        f64 result  = inputScatter + Platform::ParallelReduce( output.rowCount, grain, WeightedDistanceBlock, &data );
+        return result;
+    }
+
+
+    //the m step of one training cycle as tasks, all of it in cycle memory
+    struct CycleData
+    {
+        XMaths::Mf64 RT;
+        XMaths::Vf64 rowSums;
+        XMaths::Mf64 A;
+        XMaths::Mf64 B;
+        XMaths::Mf64 W;
+    };
+
+    void SumRowSumsTask( s32 threadIndex, void* data )
+    {
+        CycleData* cycle    = ( CycleData* ) data;
+        s32 RRowCount       = cycle->rowSums.count;
+
+        for( s32 i = 0; i < RRowCount; ++i )
+        {
+            f64 sum = 0;
+            for( s32 t = 0; t < jobCount; ++t )
+                sum += jobRowSums.m.base[ t * jobRowSums.rowStride + i ];
+
+            cycle->rowSums.v.base[ i ] = sum;
+        }
+    }
+
+    //the f32 input is centred, so its R * input is short rowSums[ i ] * inputMean on each row
+    void SumRTTask( s32 threadIndex, void* data )
+    {
+        CycleData* cycle    = ( CycleData* ) data;
+        s32 RRowCount       = cycle->RT.rowCount;
+        s32 inputColumns    = cycle->RT.columnCount;
+        s32 rowStride       = cycle->RT.rowStride;
+
+        //jobRT has the same shape, so the same stride
+        for( s32 i = 0; i < RRowCount; ++i )
+        {
+            for( s32 j = 0; j < inputColumns; ++j )
+            {
+                f64 sum = 0;
+                for( s32 t = 0; t < jobCount; ++t )
+                    sum += jobRT[ t ].m.base[ i * rowStride + j ];
+
+                cycle->RT.m.base[ i * rowStride + j ] = sum;
+            }
+        }
+
+        if( IsF32EStep() )
+        {
+            for( s32 i = 0; i < RRowCount; ++i )
+            {
+                for( s32 j = 0; j < inputColumns; ++j )
+                    cycle->RT.m.base[ i * rowStride + j ] += cycle->rowSums.v.base[ i ] * inputMean.v.base[ j ];
+            }
+        }
+    }
+
+    void AssembleATask( s32 threadIndex, void* data )
+    {
+        CycleData* cycle = ( CycleData* ) data;
+        XMaths::WeightedGram( &FI, &cycle->rowSums, &cycle->A );
+    }
+
+    void AssembleBTask( s32 threadIndex, void* data )
+    {
+        CycleData* cycle = ( CycleData* ) data;
+        XMaths::Evaluate( &cycle->B, XMaths::Transposed( &FI ) * cycle->RT );
+    }
+
+    void SolveTask( s32 threadIndex, void* data )
+    {
+        CycleData* cycle = ( CycleData* ) data;
+        XMaths::SolveSymmetric( &cycle->A, &cycle->B, &cycle->W );
+    }
+
+    void OutputTask( s32 threadIndex, void* data )
+    {
+        CycleData* cycle = ( CycleData* ) data;
+        XMaths::Evaluate( &output, XMaths::Lazy( &FI ) * cycle->W );
+    }
+
+    void EStepOutputTask( s32 threadIndex, void* data )
+    {
+        SetEStepOutput();
+    }
+
+    void BetaTask( s32 threadIndex, void* data )
+    {
+        CycleData* cycle = ( CycleData* ) data;
+        beta = ( f64 ) ( input.rowCount * input.columnCount ) / GetWeightedDistanceSum( &cycle->RT, &cycle->rowSums );
+    }
+}
+
+namespace GTM
+{
+    void Create2dData()
+    {
+        noLatVarSample      = 20;
+        latentDimensions    = 1;
+        noBasisFunction     = 5;
+        s                   = 2;
+        dataDimensions      = 2;
+
+        input               = XMaths::CreateMf64( 59, dataDimensions );
+        f64* iPtr           = input.m.base;
+        for( f32 x = 0.15f; x <= 3.05f; x += 0.05f, iPtr += input.rowStride )
+        {
+            iPtr[ 0 ] = x;
+            iPtr[ 1 ] = x + 1.25f * sin( 2.0f * x );
+        }
+    }
+
+    bool LoadGTMData( char* filename )
+    {
+        FILE *file = fopen( filename, "rt" );
+
+        if( file == NULL )
+        {
+            LOG( "Could not load GTM data\n" );
+            return false;
+        }
+
+        const s32 length = 256;
+        char aiName[ length ];
+        s32 aiVersion = 1;
+        fscanf( file, "%s %d", aiName, &aiVersion );
+        fscanf( file, "%d %d", &inputCount, &outputCount );
+        fscanf( file, "%d %d %d", &noBasisFunction, &noLatVarSample, &s );
+        fscanf( file, "%d %d", &latentDimensions, &dataDimensions );
+
+        s32 x = 0;
+        s32 y = 0;
+        fscanf( file, "%d %d", &x, &y );
+
+        if( x <= 0 || y != dataDimensions )
+        {
+            LOG( "Invalid GTM data size %d x %d\n", x, y );
+            fclose( file );
+            return false;
+        }
+
+        input = XMaths::CreateMf64( x, y );
+
+        for( s32 i = 0; i < x; ++i )
+        {
+            for( s32 j = 0; j < y; ++j )
+            {
+                f64 temp;
+                if( fscanf( file, "%lf", &temp ) != 1 )
+                {
+                    LOG( "GTM data ended after %d values\n", i * y + j );
+                    fclose( file );
+                    return false;
+                }
+
+                input.m.base[ i * input.rowStride + j ] = temp;
+            }
+        }
+
+        fclose( file );
+
+        return true;
+    }
+
+
+    Parameters GetParameters()
+    {
+        Parameters result = { noBasisFunction, noLatVarSample, s, latentDimensions };
+        return result;
+    }
+
+    void SetParameters( Parameters parameters )
+    {
+        noBasisFunction     = parameters.noBasisFunction;
+        noLatVarSample      = parameters.noLatVarSample;
+        s                   = parameters.s;
+        latentDimensions    = parameters.latentDimensions;
+    }
+
+    void SetPrecision( Precision value )
+    {
+        precision = value;
+    }
+
+    Precision GetPrecision()
+    {
+        return precision;
+    }
+
+    void SetPruning( f64 tolerance )
+    {
+        pruning = tolerance;
+    }
+
+    f64 GetPruning()
+    {
+        return pruning;
+    }
+
+    bool ValidateParameters()
+    {
+        bool result = input.rowCount > 1;
+        result &= dataDimensions == input.columnCount;
+        result &= latentDimensions > 0;
+        result &= latentDimensions <= 3;
+        result &= dataDimensions >= latentDimensions;
+        result &= noBasisFunction > 1;
+        result &= noLatVarSample > 1;
+        result &= s > 0;
+        return result;
+    }
+
+
+    XMaths::Mf64* GetInput()
+    {
+        return &input;
+    }
+
+    XMaths::Mf64* GetOutput()
+    {
+        return &output;
+    }
+
+    f64 GetBeta()
+    {
+        return beta;
+    }
+
+    s32 GetCycles()
+    {
+        return cycles;
+    }
+
+    f64* GetLLH()
+    {
+        return llh;
+    }
+
+    void SaveGTM( char* filename )
+    {
+        FILE *file = fopen( filename, "wb" );
+        if( file == NULL )
+        {
+            LOG( "Could not save GTM" );
+            return;
+        }
+
+        const s32 length = 32;
+        char aiName[ length ];
+        sprintf( aiName, "GTM!" );
+        fwrite( aiName, length * sizeof( char ), 1, file );
+        s32 aiVersion = 3;
+        fwrite( &aiVersion, sizeof( s32 ), 1, file );
+
+        fwrite( &inputCount, sizeof( s32 ), 1, file );
+        fwrite( &outputCount, sizeof( s32 ), 1, file );
+
+        fwrite( &noBasisFunction, sizeof( s32 ), 1, file );
+        fwrite( &noLatVarSample, sizeof( s32 ), 1, file );
+        fwrite( &s, sizeof( s32 ), 1, file );
+
+        fwrite( &latentDimensions, sizeof( s32 ), 1, file );
+        fwrite( &dataDimensions, sizeof( s32 ), 1, file );
+
+        //rows are written without their padding
+        for( s32 i = 0; i < output.rowCount; ++i )
+            fwrite( &output.m.base[ i * output.rowStride ], sizeof( f64 ), output.columnCount, file );
+
+        fclose( file );
+    }
+
+    void SaveLLH( char* filename, f32 time )
+    {
+        FILE *file = fopen( filename, "wt" );
+        if( file == NULL )
+        {
+            LOG( "Could not save LLH" );
+            return;
+        }
+
+        const s32 length = 256;
+        char outputString[ length ];
+
+        for( s32 i = 0; i < cycles; ++i )
+        {
+            sprintf( outputString, "%f\n", llh[ i ] );
+            fwrite( outputString, strlen( outputString ) * sizeof( char ), 1, file );
+        }
+
+        sprintf( outputString, "time: %fms", time * 1000.0f );
+        fwrite( outputString, strlen( outputString ) * sizeof( char ), 1, file );
+
+        fclose( file );
+    }
+
+    void SaveResults( char* directory, f32 time )
+    {
+        const s32 length = 1024;
+        char filename[ length ];
+
+        char* separator = "/";
+        if( directory == NULL )
+        {
+            directory = "";
+            separator = "";
+        }
+
+        snprintf( filename, length, "%s%sgtm_llh_%d^%d_%d_%d.nn", directory, separator, noLatVarSample, latentDimensions, noBasisFunction, s );
+        SaveLLH( filename, time );
+
+        snprintf( filename, length, "%s%sgtm_%d^%d_%d_%d.nn", directory, separator, noLatVarSample, latentDimensions, noBasisFunction, s );
+        SaveGTM( filename );
+    }
+
+
+    void Setup()
+    {
+        if( !llh )
+            llh = new f64[ MAX_ITERATIONS ];
+
+        //input never changes, so its norms for the gemm distance and its scatter about the mean are only computed once
+        inputMean           = XMaths::GetMeanColumns( &input );
+
+        inputScatter = 0;
+        for( s32 i = 0; i < input.rowCount; ++i )
+        {
+            for( s32 j = 0; j < input.columnCount; ++j )
+            {
+                f64 diff        = input.m.base[ i * input.rowStride + j ] - inputMean.v.base[ j ];
+                inputScatter    += diff * diff;
+            }
+        }
+
+        s32* count = new s32[ latentDimensions ];
+        for( s32 i = 0; i < latentDimensions; ++i )
+            count[ i ] = noLatVarSample;
+
+        s32 total = XMaths::ArrayProduct( count, latentDimensions );
+        XMaths::Mf64 X = XMaths::CreateMf64( total, latentDimensions );
+        XMaths::Grid( &X, count );
+
+        for( s32 i = 0; i < latentDimensions; ++i )
+            count[ i ] = noBasisFunction;
+
+        total = XMaths::ArrayProduct( count, latentDimensions );
+        XMaths::Mf64 MU = XMaths::CreateMf64( total, latentDimensions );
+        XMaths::Grid( &MU, count );
+
+        delete [] count;
+
+        f64 sigma = s * ( 2.0 / ( ( f64 ) noBasisFunction - 1.0 ) );
+
+        FI = XMaths::CreateMf64( X.rowCount, MU.rowCount + 1 );
+        XMaths::Distance( &MU, &X, &FI );
+        FI *= -1.0 / ( 2.0 * sigma * sigma );
+        XMaths::ExpEquals( &FI );
+
+        for( s32 i = 0; i < FI.rowCount; ++i )
+            FI.m.base[ i * FI.rowStride + ( FI.columnCount - 1 ) ] = 1;
+
+        SetInitialOutput( &X );
+
+        s32 RRowCount       = output.rowCount;
+        s32 processorCount  = Platform::GetProcessorCount();
+
+        s32 elementSize     = IsF32EStep() ? sizeof( f32 ) : sizeof( f64 );
+        tileCount           = RESPONSIBILITY_TILE_BYTES / ( RRowCount * elementSize );
+        tileCount           = Utils::Min( Utils::Max( tileCount & ~7, 8 ), RESPONSIBILITY_TILE_MAX_COUNT );
+
+        if( IsF32EStep() )
+        {
+            eStepF32.input              = XMaths::CreateMf32( input.rowCount, input.columnCount );
+            XMaths::Convert( &input, &inputMean, &eStepF32.input );
+            eStepF32.inputSquaredNorms  = XMaths::GetSquaredRowNorms( &eStepF32.input );
+            eStepF32.output             = XMaths::CreateMf32( output.rowCount, output.columnCount );
+
+            CreateThreadTiles( &eStepF32, processorCount, RRowCount );
+
+            delete [] eStepF32.threadProducts;
+            eStepF32.threadProducts = new XMaths::Mf32[ processorCount ];
+
+            for( s32 i = 0; i < processorCount; ++i )
+                eStepF32.threadProducts[ i ] = XMaths::CreateMf32( RRowCount, input.columnCount );
+        }
+        else
+        {
+            //input was written by the thread that loaded it, on several NUMA nodes the e step reads a copy
+            //whose rows were first touched on the nodes that run them
+            if( Platform::GetNodeCount() > 1 )
+            {
+                eStepF64.input = XMaths::CreateMf64( input.rowCount, input.columnCount );
+                XMaths::Convert( &input, 0, &eStepF64.input );
+            }
+            else
+            {
+                eStepF64.input = input;
+            }
+
+            if( pruning > 0 )
+            {
+                //a data point can keep every latent point, rows are padded apart so threads never share a line
+                threadNeighbourWeights  = XMaths::CreateMf64( processorCount, RRowCount );
+                threadNeighbours        = Array< s32 >( processorCount * threadNeighbourWeights.rowStride, CACHE_LINE_SIZE );
+            }
+            else
+            {
+                eStepF64.inputSquaredNorms  = XMaths::GetSquaredRowNorms( &eStepF64.input );
+
+                CreateThreadTiles( &eStepF64, processorCount, RRowCount );
+            }
+        }
+
+        SetEStepOutput();
+
+        delete [] jobRT;
+
+        jobCount    = processorCount * RESPONSIBILITY_JOBS_PER_THREAD;
+        jobRT       = new XMaths::Mf64[ jobCount ];
+
+        for( s32 i = 0; i < jobCount; ++i )
+            jobRT[ i ] = XMaths::CreateMf64( RRowCount, input.columnCount );
+
+        jobRowSums = XMaths::CreateMf64( jobCount, RRowCount );
+
+        XMaths::ReserveWorkerBuffers();
+    }
+
+    void Train()
+    {
+        s32 RRowCount       = output.rowCount;
+        s32 RColumnCount    = input.rowCount;
+        s32 inputColumns    = input.columnCount;
+
+        cycleArena.Reset();
+
+        for( s32 i = 0; i < jobCount; ++i )
+            memset( jobRT[ i ].m.base, 0, sizeof( f64 ) * RRowCount * jobRT[ i ].rowStride );
+
+        memset( jobRowSums.m.base, 0, sizeof( f64 ) * jobRowSums.rowCount * jobRowSums.rowStride );
+
+
+        f64 logSum;
+        if( IsF32EStep() )
+            logSum = CalculateResponsibilities( &eStepF32 );
+        else if( pruning > 0 )
+            logSum = CalculatePrunedResponsibilities();
+        else
+            logSum = CalculateResponsibilities( &eStepF64 );
+
+        s32 basisCount  = FI.columnCount;
+
+        CycleData cycle;
+        cycle.RT        = XMaths::CreateMf64( RRowCount, inputColumns, &cycleArena );
+        cycle.rowSums   = XMaths::CreateVf64( RRowCount, &cycleArena );
+        cycle.A         = XMaths::CreateMf64( basisCount, basisCount, &cycleArena );
+        cycle.B         = XMaths::CreateMf64( basisCount, inputColumns, &cycleArena );
+        cycle.W         = XMaths::CreateMf64( basisCount, inputColumns, &cycleArena );
+
+        //A only needs the row sums and B only RT, so the two products run side by side
+        Platform::TaskHandle rowSumsTask    = Platform::AddTask( SumRowSumsTask, &cycle );
+        Platform::TaskHandle RTTask         = IsF32EStep() ? Platform::AddTask( SumRTTask, &cycle, &rowSumsTask, 1 )
+                                                           : Platform::AddTask( SumRTTask, &cycle );
+        Platform::TaskHandle solveDependencies[] = { Platform::AddTask( AssembleATask, &cycle, &rowSumsTask, 1 ),
+                                                     Platform::AddTask( AssembleBTask, &cycle, &RTTask, 1 ) };
+        Platform::TaskHandle solveTask      = Platform::AddTask( SolveTask, &cycle, solveDependencies, 2 );
+        Platform::TaskHandle outputTask     = Platform::AddTask( OutputTask, &cycle, &solveTask, 1 );
+        Platform::AddTask( EStepOutputTask, &cycle, &outputTask, 1 );
+        Platform::AddTask( BetaTask, &cycle, &outputTask, 1 );
+
+        llh[ cycles ] = ( input.columnCount / 2.0 ) * log( beta * INV_TAU ) - log( ( f64 ) noLatVarSample );
+        llh[ cycles ] = logSum + RColumnCount * llh[ cycles ];
+
+        Platform::RunTasks();
+    }
+
+    void TrainUntilConverged()
+    {
+        cycles = 0;
+
+        while( cycles <= 1 || fabs( llh[ cycles - 1 ] - llh[ cycles - 2 ] ) > 0.01f )
+        {
+            f32 cycleTime;
+            {
+                TIMED_BLOCK( &cycleTime );
+                Train();
+            }
+
+            ++cycles;
+            LOG( "cycles: %d, time: %fms\n", cycles, cycleTime * 1000.0f );
+
+            if( cycles >= MAX_ITERATIONS )
+                break;
+        }
+
+        LOG( "workspace high water mark: cycle %lld bytes, xmaths %lld bytes\n", cycleArena.highWaterMark, XMaths::GetWorkspaceHighWaterMark() );
+    }
+}
\ No newline at end of file
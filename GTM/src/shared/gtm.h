@@ -0,0 +1,71 @@
+#ifndef GTM_H
+#define GTM_H
+
+
+#include "types.h"
+#include "xmaths.h"
+
+
+namespace GTM
+{
+    const s32 MAX_ITERATIONS = 10000;
+
+
+    struct Parameters
+    {
+        s32 noBasisFunction;
+        s32 noLatVarSample;
+
+        s32 s;
+
+        s32 latentDimensions;
+    };
+
+    //with F32 the e step distances, exponentials and responsibilities are f32 while logSum, llh and the m step stay f64,
+    //building with GTM_F32 defined makes it the default
+    enum Precision
+    {
+        Precision_F64 = 0,
+        Precision_F32
+    };
+
+
+    void Create2dData();
+    bool LoadGTMData( char* filename );
+
+    Parameters GetParameters();
+    void SetParameters( Parameters parameters );
+    bool ValidateParameters();
+
+    //takes effect from the next Setup
+    void SetPrecision( Precision precision );
+    Precision GetPrecision();
+
+    //above 0 the e step only evaluates, for each data point, the latent points near enough its nearest one that
+    //leaving the rest out can lower the point's log likelihood by at most tolerance / the data point count, found
+    //through a k-d tree over the output rebuilt every cycle; each cycle's llh is then at most tolerance below the exact
+    //llh of that cycle's output and beta, not of the exact run, whose m steps see other responsibilities and so take
+    //another path; the pruned e step always runs in f64 and pays with many latent points over data of few dimensions,
+    //where the tree can rule most of them out; 0, the default, is the exact dense e step; takes effect from the next Setup
+    void SetPruning( f64 tolerance );
+    f64 GetPruning();
+
+    void Setup();
+    void Train();
+    void TrainUntilConverged();
+
+    XMaths::Mf64* GetInput();
+    XMaths::Mf64* GetOutput();
+    f64 GetBeta();
+    s32 GetCycles();
+    //one entry per cycle
+    f64* GetLLH();
+
+    void SaveGTM( char* filename );
+    void SaveLLH( char* filename, f32 time );
+    //directory can be NULL to save into the working directory
+    void SaveResults( char* directory, f32 time );
+}
+
+
+#endif
\ No newline at end of file
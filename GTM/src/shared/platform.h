@@ -12,9 +12,57 @@ namespace Platform
 
     extern s32 GetProcessorCount();
 
+
+    //where the pages of large arrays go on a machine with several NUMA nodes: with first touch each page goes to
+    //the node of the thread that writes it first, and ParallelFor on pinned threads runs row ranges on the same
+    //node every time, so rows written through it stay local to their readers; interleave spreads pages over every node
+    enum NumaPolicy
+    {
+        NumaPolicy_FirstTouch = 0,
+        NumaPolicy_Interleave
+    };
+
+    //the nodes the pinned threads are spread over, 1 when they are not pinned
+    extern s32 GetNodeCount();
+    //applies the NUMA policy to memory nothing has touched yet
+    extern void PlaceMemory( void* memory, s64 size );
+
     typedef void WorkCallback( s32 threadIndex, void* data );
     extern void AddWorkQueueEntry( WorkCallback* callback, void* data );
     extern void FinishWork();
+
+
+    //a job of simple loop iterations is only worth queueing with at least this much work in it
+    const s32 PARALLEL_MIN_JOB_WORK     = 16 * 1024;
+    //more jobs than threads so stealing can even out jobs that take longer than others
+    const s32 PARALLEL_JOBS_PER_THREAD  = 8;
+
+    //the fewest iterations worth a job of their own when each does about workPerIteration simple operations
+    inline s32 GetGrain( s64 workPerIteration )
+    {
+        s64 result = workPerIteration > 0 ? PARALLEL_MIN_JOB_WORK / workPerIteration : PARALLEL_MIN_JOB_WORK;
+        return result > 0 ? ( s32 ) result : 1;
+    }
+
+    typedef void ParallelForCallback( s32 threadIndex, s32 startIndex, s32 endIndexPlus1, void* data );
+    typedef f64 ParallelReduceCallback( s32 threadIndex, s32 startIndex, s32 endIndexPlus1, void* data );
+
+    //splits [ 0, count ) into jobs of at least grain iterations, GetGrain( 1 ) when grain is 0, and returns once they
+    //have all run; a range that makes a single job runs on the calling thread without waking anyone, otherwise the
+    //jobs are queued together, the workers are woken once for all of them and the calling thread takes the first
+    extern void ParallelFor( s32 count, s32 grain, ParallelForCallback* callback, void* data );
+    //as ParallelFor, returning the sum of what the jobs return, added up in range order so the result only
+    //depends on count, grain and the processor count
+    extern f64 ParallelReduce( s32 count, s32 grain, ParallelReduceCallback* callback, void* data );
+
+
+    //work with dependencies: AddTask returns a handle for later tasks to depend on, so tasks are added after
+    //everything they need; RunTasks starts each task on any thread as soon as its dependencies have run and returns
+    //once every task has, leaving the graph empty; tasks can use ParallelFor and AddWorkQueueEntry themselves
+    typedef s32 TaskHandle;
+
+    extern TaskHandle AddTask( WorkCallback* callback, void* data, TaskHandle* dependencies = 0, s32 dependencyCount = 0 );
+    extern void RunTasks();
 }
 
 
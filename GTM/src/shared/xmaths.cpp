@@ -1,950 +1,3967 @@
 #include "xmaths.h"
 #include "platform.h"
 
+#include <float.h>
 #include <math.h>
+#include <string.h>
+
+#include <atomic>
+
+#if defined( __AVX2__ )
+    #define XMATHS_AVX2
+    #include <immintrin.h>
+#endif
+
+//scalar and vector paths use fused multiply-add together or not at all so they round the same way
+#if defined( __FMA__ ) || ( defined( _MSC_VER ) && defined( XMATHS_AVX2 ) )
+    #define FMADD( a, b, c ) fma( ( a ), ( b ), ( c ) )
+    #define FMADDF( a, b, c ) fmaf( ( a ), ( b ), ( c ) )
+    #define FMADD_PD( a, b, c ) _mm256_fmadd_pd( ( a ), ( b ), ( c ) )
+    #define FNMADD_PD( a, b, c ) _mm256_fnmadd_pd( ( a ), ( b ), ( c ) )
+    #define FMADD_PS( a, b, c ) _mm256_fmadd_ps( ( a ), ( b ), ( c ) )
+    #define FNMADD_PS( a, b, c ) _mm256_fnmadd_ps( ( a ), ( b ), ( c ) )
+#else
+    #define FMADD( a, b, c ) ( ( a ) * ( b ) + ( c ) )
+    #define FMADDF( a, b, c ) ( ( a ) * ( b ) + ( c ) )
+    #define FMADD_PD( a, b, c ) _mm256_add_pd( _mm256_mul_pd( ( a ), ( b ) ), ( c ) )
+    #define FNMADD_PD( a, b, c ) _mm256_sub_pd( ( c ), _mm256_mul_pd( ( a ), ( b ) ) )
+    #define FMADD_PS( a, b, c ) _mm256_add_ps( _mm256_mul_ps( ( a ), ( b ) ), ( c ) )
+    #define FNMADD_PS( a, b, c ) _mm256_sub_ps( ( c ), _mm256_mul_ps( ( a ), ( b ) ) )
+#endif
 
 
 namespace
 {
-    struct Mf64MultiplyBlockData
+    //exp reduces x = n * ln2 + r with |r| <= ln2 / 2 using a two part ln2, evaluates the degree 13 taylor
+    //series of exp( r ) and adds n straight onto the exponent bits, results that would be denormal are
+    //built 64 powers of 2 higher and scaled down with one multiply so they round once;
+    //log splits x = 2^e * m with m in [ sqrt( 0.5 ), sqrt( 2 ) ) and sums the atanh series of s = ( m - 1 ) / ( m + 1 )
+    //to s^23. Measured against a long double reference exp is within 1 ulp and log within 2 ulp, and the
+    //scalar and AVX2 paths give identical bits, so which elements take the scalar tail never changes a result.
+    //The scaling is done in integer bits so -ffast-math cannot reassociate it into an overflow
+    const f64 EXP_MIN_INPUT         = -746.0;
+    const f64 EXP_MAX_INPUT         = 710.0;
+    const f64 EXP_OVERFLOW_INPUT    = 709.782712893384;
+    const f64 EXP_DENORMAL_N        = -1021.0;
+    const f64 EXP_DENORMAL_SHIFT    = 64.0;
+    const f64 EXP_DENORMAL_SCALE    = 5.421010862427522170e-20;
+
+    const f64 LOG2E         = 1.4426950408889634074;
+    const f64 LN2_HI        = 6.93147180369123816490e-01;
+    const f64 LN2_LO        = 1.90821492927058770002e-10;
+    const f64 SQRT2         = 1.4142135623730950488;
+
+    //1 / k! for k = 13 down to 2, the k = 1 and k = 0 terms are added as 1
+    const f64 EXP_COEFFICIENTS[] = { 1.0 / 6227020800.0, 1.0 / 479001600.0, 1.0 / 39916800.0, 1.0 / 3628800.0,
+                                     1.0 / 362880.0, 1.0 / 40320.0, 1.0 / 5040.0, 1.0 / 720.0,
+                                     1.0 / 120.0, 1.0 / 24.0, 1.0 / 6.0, 1.0 / 2.0 };
+
+    //1 / ( 2k + 1 ) for k = 11 down to 1
+    const f64 LOG_COEFFICIENTS[] = { 1.0 / 23.0, 1.0 / 21.0, 1.0 / 19.0, 1.0 / 17.0, 1.0 / 15.0, 1.0 / 13.0,
+                                     1.0 / 11.0, 1.0 / 9.0, 1.0 / 7.0, 1.0 / 5.0, 1.0 / 3.0 };
+
+    //2^52 + 2^51, adding it to a whole f64 leaves the integer in the low mantissa bits
+    const f64 ROUND_MAGIC   = 6755399441055744.0;
+
+    //the f32 exp is the same scheme with a degree 7 series and the cephes split of ln2
+    const f32 EXP_MIN_INPUT_F32         = -104.0f;
+    const f32 EXP_MAX_INPUT_F32         = 89.0f;
+    const f32 EXP_OVERFLOW_INPUT_F32    = 88.7228394f;
+    const s32 EXP_DENORMAL_N_F32        = -125;
+    const s32 EXP_DENORMAL_SHIFT_F32    = 32;
+    const f32 EXP_DENORMAL_SCALE_F32    = 2.32830644e-10f;
+
+    const f32 LOG2E_F32     = 1.44269504f;
+    const f32 LN2_HI_F32    = 0.693359375f;
+    const f32 LN2_LO_F32    = -2.12194440e-4f;
+
+    //1 / k! for k = 7 down to 2
+    const f32 EXP_COEFFICIENTS_F32[] = { 1.0f / 5040.0f, 1.0f / 720.0f, 1.0f / 120.0f, 1.0f / 24.0f, 1.0f / 6.0f, 1.0f / 2.0f };
+
+
+    //p * 2^n for whole n when the result is normal
+    f64 AddExponent( f64 p, f64 n )
     {
-        s32 columnCount;
-        s32 nRowCount;
-        s32 nColumnCount;
+        u64 bits;
+        memcpy( &bits, &p, sizeof( bits ) );
+        bits += ( u64 ) ( s64 ) n << 52;
 
-        s32 iJumpCount;
-        s32 jJumpCount;
-        s32 kJumpCount;
+        f64 result;
+        memcpy( &result, &bits, sizeof( result ) );
+        return result;
+    }
 
-        s32 indexR;
-        s32 indexM;
-        s32 j;
+    f64 ExpScalar( f64 x )
+    {
+        if( x != x )
+            return x;
 
-        XMaths::Mf64* result;
-        XMaths::Mf64* m;
-        XMaths::Mf64* n;
-    };
+        x = fmin( fmax( x, EXP_MIN_INPUT ), EXP_MAX_INPUT );
 
+        f64 n = nearbyint( x * LOG2E );
+        f64 r = FMADD( -n, LN2_HI, x );
+        r     = FMADD( -n, LN2_LO, r );
 
-    void Mf64MultiplyBlock( s32 threadIndex, void* data )
-    {
-        Mf64MultiplyBlockData* mf64MultiplyBlockData = ( Mf64MultiplyBlockData* ) data;
+        f64 p = EXP_COEFFICIENTS[ 0 ];
+        for( s32 i = 1; i < ( s32 ) ARRAY_COUNT( EXP_COEFFICIENTS ); ++i )
+            p = FMADD( p, r, EXP_COEFFICIENTS[ i ] );
 
-        s32 columnCount         = mf64MultiplyBlockData->columnCount;
-        s32 nRowCount           = mf64MultiplyBlockData->nRowCount;
-        s32 nColumnCount        = mf64MultiplyBlockData->nColumnCount;
+        p = FMADD( p, r, 1.0 );
+        p = FMADD( p, r, 1.0 );
 
-        s32 iJumpCount          = mf64MultiplyBlockData->iJumpCount;
-        s32 jJumpCount          = mf64MultiplyBlockData->jJumpCount;
-        s32 kJumpCount          = mf64MultiplyBlockData->kJumpCount;
+        f64 result;
+        if( n < EXP_DENORMAL_N )
+            result = AddExponent( p, n + EXP_DENORMAL_SHIFT ) * EXP_DENORMAL_SCALE;
+        else
+            result = AddExponent( p, n );
 
-        s32 indexR              = mf64MultiplyBlockData->indexR;
-        s32 indexM              = mf64MultiplyBlockData->indexM;
-        s32 j                   = mf64MultiplyBlockData->j;
+        if( x > EXP_OVERFLOW_INPUT )
+            result = HUGE_VAL;
 
-        XMaths::Mf64* result    = mf64MultiplyBlockData->result;
-        f64* rArrayPtr          = result->m.base;
-        XMaths::Mf64* m         = mf64MultiplyBlockData->m;
-        f64* mArrayPtr          = m->m.base;
-        XMaths::Mf64* n         = mf64MultiplyBlockData->n;
-        f64* nArrayPtr          = n->m.base;
+        return result;
+    }
 
-        for( s32 k = 0; k < nRowCount; k += kJumpCount )
+    f64 LogNormalScalar( f64 x )
+    {
+        u64 bits;
+        memcpy( &bits, &x, sizeof( bits ) );
+
+        f64 e = ( f64 ) ( ( s64 ) ( bits >> 52 ) - 1023 );
+        bits = ( bits & 0x000fffffffffffffull ) | 0x3ff0000000000000ull;
+
+        f64 m;
+        memcpy( &m, &bits, sizeof( m ) );
+
+        if( m > SQRT2 )
         {
-            kJumpCount  = Utils::Min( kJumpCount, nRowCount - k );
+            m *= 0.5;
+            e += 1.0;
+        }
 
-            f64* rPtr   = &rArrayPtr[ indexR + j ];
-            f64* mPtr   = &mArrayPtr[ indexM + k ];
+        f64 s = ( m - 1.0 ) / ( m + 1.0 );
+        f64 z = s * s;
 
-            s32 indexN  = k * nColumnCount;
+        f64 p = LOG_COEFFICIENTS[ 0 ];
+        for( s32 i = 1; i < ( s32 ) ARRAY_COUNT( LOG_COEFFICIENTS ); ++i )
+            p = FMADD( p, z, LOG_COEFFICIENTS[ i ] );
 
-            for( s32 a = 0; a < iJumpCount; ++a, rPtr += nColumnCount, mPtr += columnCount )
-            {
-                f64* nPtr = &nArrayPtr[ indexN + j ];
+        f64 s2      = s + s;
+        f64 tail    = FMADD( s2 * z, p, e * LN2_LO );
+        f64 result  = FMADD( e, LN2_HI, s2 + tail );
+        return result;
+    }
 
-                for( s32 c = 0; c < kJumpCount; ++c, nPtr += nColumnCount )
-                {
-                    f64 element = mPtr[ c ];
-                    for( s32 b = 0; b < jJumpCount; ++b )
-                        rPtr[ b ] += element * nPtr[ b ];
-                }
-            }
-        }
+    f64 LogScalar( f64 x )
+    {
+        if( x != x || x == HUGE_VAL )
+            return x;
+        if( x < 0 )
+            return NAN;
+        if( x == 0 )
+            return -HUGE_VAL;
+
+        //denormals are scaled into the normal range first
+        if( x < DBL_MIN )
+            return LogNormalScalar( x * 18014398509481984.0 ) - 54.0 * LN2_HI - 54.0 * LN2_LO;
+
+        return LogNormalScalar( x );
     }
 
+    f32 AddExponent( f32 p, s32 n )
+    {
+        u32 bits;
+        memcpy( &bits, &p, sizeof( bits ) );
+        bits += ( u32 ) n << 23;
 
-    struct DistanceBlockData
+        f32 result;
+        memcpy( &result, &bits, sizeof( result ) );
+        return result;
+    }
+
+    f32 ExpScalar( f32 x )
     {
-        s32 startIndex;
-        s32 endIndexPlus1;
+        if( x != x )
+            return x;
 
-        s32 rColumnCount;
-        s32 mColumnCount;
-        s32 nColumnCount;
+        x = fminf( fmaxf( x, EXP_MIN_INPUT_F32 ), EXP_MAX_INPUT_F32 );
 
-        s32 iJumpCount;
-        s32 jJumpCount;
+        f32 n = nearbyintf( x * LOG2E_F32 );
+        f32 r = FMADDF( -n, LN2_HI_F32, x );
+        r     = FMADDF( -n, LN2_LO_F32, r );
 
-        s32 indexR;
-        s32 indexN;
+        f32 p = EXP_COEFFICIENTS_F32[ 0 ];
+        for( s32 i = 1; i < ( s32 ) ARRAY_COUNT( EXP_COEFFICIENTS_F32 ); ++i )
+            p = FMADDF( p, r, EXP_COEFFICIENTS_F32[ i ] );
 
-        XMaths::Mf64* result;
-        XMaths::Mf64* m;
-        XMaths::Mf64* n;
-    };
+        p = FMADDF( p, r, 1.0f );
+        p = FMADDF( p, r, 1.0f );
 
+        s32 e = ( s32 ) n;
 
-    void Mf64DistanceBlock( s32 threadIndex, void* data )
-    {
-        DistanceBlockData* distanceBlockData = ( DistanceBlockData* ) data;
+        f32 result;
+        if( e < EXP_DENORMAL_N_F32 )
+            result = AddExponent( p, e + EXP_DENORMAL_SHIFT_F32 ) * EXP_DENORMAL_SCALE_F32;
+        else
+            result = AddExponent( p, e );
 
-        s32 startIndex          = distanceBlockData->startIndex;
-        s32 endIndexPlus1       = distanceBlockData->endIndexPlus1;
+        if( x > EXP_OVERFLOW_INPUT_F32 )
+            result = HUGE_VALF;
 
-        s32 rColumnCount        = distanceBlockData->rColumnCount;
-        s32 mColumnCount        = distanceBlockData->mColumnCount;
-        s32 nColumnCount        = distanceBlockData->nColumnCount;
+        return result;
+    }
 
-        s32 iJumpCount          = distanceBlockData->iJumpCount;
-        s32 jJumpCount          = distanceBlockData->jJumpCount;
+#ifdef XMATHS_AVX2
+    __m256d AddExponent( __m256d p, __m256d n )
+    {
+        //the low 12 bits of the magic sum are n modulo 4096, which is all that survives the shift
+        __m256i exponent = _mm256_slli_epi64( _mm256_castpd_si256( _mm256_add_pd( n, _mm256_set1_pd( ROUND_MAGIC ) ) ), 52 );
+        return _mm256_castsi256_pd( _mm256_add_epi64( _mm256_castpd_si256( p ), exponent ) );
+    }
 
-        s32 indexR              = distanceBlockData->indexR;
-        s32 indexN              = distanceBlockData->indexN;
+    __m256d Exp4( __m256d x )
+    {
+        __m256d input   = x;
+        __m256d nan     = _mm256_cmp_pd( x, x, _CMP_UNORD_Q );
 
-        XMaths::Mf64* result    = distanceBlockData->result;
-        f64* rArrayPtr          = result->m.base;
-        XMaths::Mf64* m         = distanceBlockData->m;
-        f64* mArrayPtr          = m->m.base;
-        XMaths::Mf64* n         = distanceBlockData->n;
-        f64* nArrayPtr          = n->m.base;
+        x = _mm256_max_pd( x, _mm256_set1_pd( EXP_MIN_INPUT ) );
+        x = _mm256_min_pd( x, _mm256_set1_pd( EXP_MAX_INPUT ) );
 
-        for( s32 j = startIndex; j < endIndexPlus1; j += jJumpCount )
-        {
-            jJumpCount      = Utils::Min( jJumpCount, endIndexPlus1 - j );
-            s32 kJumpCount  = F64_PER_CACHE_LINE * 32;
-            kJumpCount      = Utils::Min( kJumpCount, nColumnCount );
+        __m256d n = _mm256_round_pd( _mm256_mul_pd( x, _mm256_set1_pd( LOG2E ) ), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC );
+        __m256d r = FNMADD_PD( n, _mm256_set1_pd( LN2_HI ), x );
+        r         = FNMADD_PD( n, _mm256_set1_pd( LN2_LO ), r );
 
-            s32 indexM      = j * mColumnCount;
+        __m256d p = _mm256_set1_pd( EXP_COEFFICIENTS[ 0 ] );
+        for( s32 i = 1; i < ( s32 ) ARRAY_COUNT( EXP_COEFFICIENTS ); ++i )
+            p = FMADD_PD( p, r, _mm256_set1_pd( EXP_COEFFICIENTS[ i ] ) );
 
-            f64* rPtr       = &rArrayPtr[ indexR + j ];
-            f64* nPtr       = &nArrayPtr[ indexN ];
+        __m256d one = _mm256_set1_pd( 1.0 );
+        p = FMADD_PD( p, r, one );
+        p = FMADD_PD( p, r, one );
 
-            for( s32 a = 0; a < iJumpCount; ++a, rPtr += rColumnCount, nPtr += nColumnCount )
-            {
-                f64* mPtr = &mArrayPtr[ indexM ];
+        __m256d denormal    = _mm256_cmp_pd( n, _mm256_set1_pd( EXP_DENORMAL_N ), _CMP_LT_OQ );
+        n                   = _mm256_add_pd( n, _mm256_and_pd( denormal, _mm256_set1_pd( EXP_DENORMAL_SHIFT ) ) );
+        __m256d scale       = _mm256_blendv_pd( one, _mm256_set1_pd( EXP_DENORMAL_SCALE ), denormal );
 
-                for( s32 b = 0; b < jJumpCount; ++b, mPtr += mColumnCount )
-                {
-                    f64 sum = 0;
-                    for( s32 c = 0; c < kJumpCount; ++c )
-                    {
-                        f64 diff    = mPtr[ c ] - nPtr[ c ];
-                        sum         += diff * diff;
-                    }
+        __m256d result = _mm256_mul_pd( AddExponent( p, n ), scale );
+        result = _mm256_blendv_pd( result, _mm256_set1_pd( HUGE_VAL ), _mm256_cmp_pd( x, _mm256_set1_pd( EXP_OVERFLOW_INPUT ), _CMP_GT_OQ ) );
+        result = _mm256_blendv_pd( result, input, nan );
+        return result;
+    }
 
-                    rPtr[ b ] = sum;
-                }
-            }
+    __m256d LogNormal4( __m256d x )
+    {
+        __m256i bits = _mm256_castpd_si256( x );
 
-            for( s32 k = kJumpCount; k < nColumnCount; k += kJumpCount )
-            {
-                kJumpCount  = Utils::Min( kJumpCount, nColumnCount - k );
+        //the exponent goes through the same magic number trick as AddExponent, in reverse
+        __m256i exponent = _mm256_add_epi64( _mm256_srli_epi64( bits, 52 ), _mm256_set1_epi64x( 0x4338000000000000ll - 1023 ) );
+        __m256d e = _mm256_sub_pd( _mm256_castsi256_pd( exponent ), _mm256_set1_pd( ROUND_MAGIC ) );
 
-                rPtr        = &rArrayPtr[ indexR + j ];
-                nPtr        = &nArrayPtr[ indexN + k ];
+        bits = _mm256_and_si256( bits, _mm256_set1_epi64x( 0x000fffffffffffffll ) );
+        bits = _mm256_or_si256( bits, _mm256_set1_epi64x( 0x3ff0000000000000ll ) );
+        __m256d m = _mm256_castsi256_pd( bits );
 
-                for( s32 a = 0; a < iJumpCount; ++a, rPtr += rColumnCount, nPtr += nColumnCount )
-                {
-                    f64* mPtr = &mArrayPtr[ indexM + k ];
+        __m256d one = _mm256_set1_pd( 1.0 );
+        __m256d large = _mm256_cmp_pd( m, _mm256_set1_pd( SQRT2 ), _CMP_GT_OQ );
+        m = _mm256_blendv_pd( m, _mm256_mul_pd( m, _mm256_set1_pd( 0.5 ) ), large );
+        e = _mm256_add_pd( e, _mm256_and_pd( large, one ) );
 
-                    for( s32 b = 0; b < jJumpCount; ++b, mPtr += mColumnCount )
-                    {
-                        f64 sum = 0;
-                        for( s32 c = 0; c < kJumpCount; ++c )
-                        {
-                            f64 diff    = mPtr[ c ] - nPtr[ c ];
-                            sum         += diff * diff;
-                        }
+        __m256d s = _mm256_div_pd( _mm256_sub_pd( m, one ), _mm256_add_pd( m, one ) );
+        __m256d z = _mm256_mul_pd( s, s );
 
-                        rPtr[ b ] += sum;
-                    }
-                }
-            }
-        }
+        __m256d p = _mm256_set1_pd( LOG_COEFFICIENTS[ 0 ] );
+        for( s32 i = 1; i < ( s32 ) ARRAY_COUNT( LOG_COEFFICIENTS ); ++i )
+            p = FMADD_PD( p, z, _mm256_set1_pd( LOG_COEFFICIENTS[ i ] ) );
+
+        __m256d s2      = _mm256_add_pd( s, s );
+        __m256d tail    = FMADD_PD( _mm256_mul_pd( s2, z ), p, _mm256_mul_pd( e, _mm256_set1_pd( LN2_LO ) ) );
+        __m256d result  = FMADD_PD( e, _mm256_set1_pd( LN2_HI ), _mm256_add_pd( s2, tail ) );
+        return result;
     }
 
-    void Exp( XMaths::Mf64* m, XMaths::Mf64* result )
+    __m256 Exp8( __m256 x )
     {
-        ASSERT( m->rowCount     == result->rowCount );
-        ASSERT( m->columnCount  == result->columnCount );
+        __m256 input    = x;
+        __m256 nan      = _mm256_cmp_ps( x, x, _CMP_UNORD_Q );
 
-        f64* rPtr = result->m.base;
-        f64* mPtr = m->m.base;
+        x = _mm256_max_ps( x, _mm256_set1_ps( EXP_MIN_INPUT_F32 ) );
+        x = _mm256_min_ps( x, _mm256_set1_ps( EXP_MAX_INPUT_F32 ) );
 
-        s32 count = m->rowCount * m->columnCount;
-        for( s32 i = 0; i < count; ++i )
-            rPtr[ i ] = ::exp( mPtr[ i ] );
+        __m256 n = _mm256_round_ps( _mm256_mul_ps( x, _mm256_set1_ps( LOG2E_F32 ) ), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC );
+        __m256 r = FNMADD_PS( n, _mm256_set1_ps( LN2_HI_F32 ), x );
+        r        = FNMADD_PS( n, _mm256_set1_ps( LN2_LO_F32 ), r );
+
+        __m256 p = _mm256_set1_ps( EXP_COEFFICIENTS_F32[ 0 ] );
+        for( s32 i = 1; i < ( s32 ) ARRAY_COUNT( EXP_COEFFICIENTS_F32 ); ++i )
+            p = FMADD_PS( p, r, _mm256_set1_ps( EXP_COEFFICIENTS_F32[ i ] ) );
+
+        __m256 one = _mm256_set1_ps( 1.0f );
+        p = FMADD_PS( p, r, one );
+        p = FMADD_PS( p, r, one );
+
+        __m256i e           = _mm256_cvtps_epi32( n );
+        __m256i denormal    = _mm256_cmpgt_epi32( _mm256_set1_epi32( EXP_DENORMAL_N_F32 ), e );
+        e                   = _mm256_add_epi32( e, _mm256_and_si256( denormal, _mm256_set1_epi32( EXP_DENORMAL_SHIFT_F32 ) ) );
+        __m256 scale        = _mm256_blendv_ps( one, _mm256_set1_ps( EXP_DENORMAL_SCALE_F32 ), _mm256_castsi256_ps( denormal ) );
+
+        __m256 result = _mm256_castsi256_ps( _mm256_add_epi32( _mm256_castps_si256( p ), _mm256_slli_epi32( e, 23 ) ) );
+        result = _mm256_mul_ps( result, scale );
+        result = _mm256_blendv_ps( result, _mm256_set1_ps( HUGE_VALF ), _mm256_cmp_ps( x, _mm256_set1_ps( EXP_OVERFLOW_INPUT_F32 ), _CMP_GT_OQ ) );
+        result = _mm256_blendv_ps( result, input, nan );
+        return result;
     }
 
-    s32 Pivot( XMaths::Mf64* m, s32 row )
+    //true if any lane is not a positive normal finite number, those go through LogScalar
+    bool LogNeedsScalar( __m256d x )
     {
-        s32 k           = row;
-        s32 size        = m->rowCount;
+        __m256d normal = _mm256_and_pd( _mm256_cmp_pd( x, _mm256_set1_pd( DBL_MIN ), _CMP_GE_OQ ),
+                                        _mm256_cmp_pd( x, _mm256_set1_pd( DBL_MAX ), _CMP_LE_OQ ) );
+        return _mm256_movemask_pd( normal ) != 0xf;
+    }
+#endif
 
-        f64* mArrayPtr  = m->m.base;
 
-        f64 max = -1;
-        for( s32 i = row; i < size; ++i )
-        {
-            f64 temp = fabs( mArrayPtr[ i * size + row ] );
-            if( temp > max && temp != 0 )
-            {
-                max = temp;
-                k = i;
-            }
-        }
+    //packed panel gemm, blocks are sized so a packed MC x KC panel of m stays in L2
+    //and one KC x NR micro panel of n stays in L1 while the micro kernel runs;
+    //a micro tile is GEMM_MR rows by one cache line of columns, 8 f64 or 16 f32, and the f32 panels
+    //use the same element counts so they fit the f64 pack buffers
+    const s32 GEMM_MR = 6;
+    const s32 GEMM_MC = GEMM_MR * 12;
+    const s32 GEMM_KC = 256;
+    const s32 GEMM_NC = 1024;
+
+    template< typename T >
+    struct Gemm
+    {
+        static const s32 NR = CACHE_LINE_SIZE / sizeof( T );
+    };
+
+    //the solvers' working storage, block sums and split k partial products, taken as temporary memory that goes back
+    //when the call returns; each thread has its own so tasks can run side by side, and a thread that helps with other
+    //work while it waits only runs whole jobs, which give back what they take first, so each is used as a stack
+    thread_local Arena workspace;
+    //the most any thread's workspace has held
+    std::atomic< s64 > workspaceHighWaterMark( 0 );
 
-        if( mArrayPtr[ k * size + row ] == 0 )
-            return -1;
+    struct WorkspaceMemory
+    {
+        TemporaryMemory temporaryMemory;
 
-        if( k != row )
+        WorkspaceMemory() : temporaryMemory( &workspace )
         {
-            f64* mPtr0 = &mArrayPtr[ k * size ];
-            f64* mPtr1 = &mArrayPtr[ row * size ];
+        }
 
-            for( s32 a = 0; a < size; ++a )
+        ~WorkspaceMemory()
+        {
+            s64 highWaterMark = workspaceHighWaterMark.load( std::memory_order_relaxed );
+            while( workspace.highWaterMark > highWaterMark &&
+                   !workspaceHighWaterMark.compare_exchange_weak( highWaterMark, workspace.highWaterMark, std::memory_order_relaxed ) )
             {
-                f64 swap = mPtr0[ a ];
-                mPtr0[ a ] = mPtr1[ a ];
-                mPtr1[ a ] = swap;
             }
-
-            return k;
         }
+    };
+    #define WORKSPACE_MEMORY() WorkspaceMemory workspaceMemory
+
 
-        return 0;
+    template< typename T >
+    void ResizeArray( Array< T >* a, s32 count )
+    {
+        if( a->count < count )
+            *a = Array< T >( count, CACHE_LINE_SIZE );
     }
 
-    XMaths::Mf64 GetCovariant( XMaths::Mf64* m )
+    s32 gemmPackBufferCount = 0;
+    f64** gemmPackA         = 0;
+    f64** gemmPackB         = 0;
+
+
+    void CreateGemmPackBuffers()
     {
-        s32 rowCount        = m->rowCount;
-        s32 columnCount     = m->columnCount;
-        XMaths::Mf64 result = XMaths::CreateMf64( columnCount, columnCount );
-        f64* rPtr           = result.m.base;
-        f64* mPtr           = m->m.base;
+        s32 processorCount = Platform::GetProcessorCount();
+        if( gemmPackBufferCount >= processorCount )
+            return;
 
-        f64 invRowCountMinus1 = 1.0 / ( ( f64 ) rowCount - 1.0 );
+        gemmPackA = new f64*[ processorCount ];
+        gemmPackB = new f64*[ processorCount ];
+
+        for( s32 i = 0; i < processorCount; ++i )
+        {
+            gemmPackA[ i ] = ( f64* ) ALIGNED_ALLOC( sizeof( f64 ) * GEMM_MC * GEMM_KC, CACHE_LINE_SIZE );
+            gemmPackB[ i ] = ( f64* ) ALIGNED_ALLOC( sizeof( f64 ) * GEMM_KC * GEMM_NC, CACHE_LINE_SIZE );
+        }
 
-        XMaths::Vf64 matrixMean = XMaths::GetMeanColumns( m );
-        f64* meanPtr = matrixMean.v.base;
+        gemmPackBufferCount = processorCount;
+    }
 
-        for( s32 i = 0; i < columnCount; ++i )
+    //packs rows [ i, i + mc ) and columns [ k, k + kc ) of m into GEMM_MR row micro panels,
+    //each stored k major so the micro kernel reads it sequentially, rows past mc are zero;
+    //the strides let a transposed m be packed in place, and column k is multiplied by scale * kScale[ k ]
+    //on the way in so a diagonal between two factors costs no pass of its own
+    template< typename T >
+    void GemmPackA( T* mPtr, s32 rowStride, s32 columnStride, s32 mc, s32 kc, T* kScale, T scale, T* packPtr )
+    {
+        for( s32 i = 0; i < mc; i += GEMM_MR )
         {
-            f64 mean0 = meanPtr[ i ];
-            s32 row = i * columnCount;
+            s32 mr = Utils::Min( GEMM_MR, mc - i );
 
-            for( s32 j = i; j < columnCount; ++j )
+            for( s32 k = 0; k < kc; ++k, packPtr += GEMM_MR )
             {
-                f64 mean1 = meanPtr[ j ];
-                f64 sum = 0;
+                T* aPtr = &mPtr[ i * rowStride + k * columnStride ];
+                T s     = kScale ? kScale[ k ] * scale : scale;
 
-                for( s32 z = 0; z < rowCount; ++z )
-                {
-                    s32 row = z * columnCount;
-                    sum += ( mPtr[ row + i ] - mean0 ) * ( mPtr[ row + j ] - mean1 );
-                }
+                for( s32 a = 0; a < mr; ++a )
+                    packPtr[ a ] = aPtr[ a * rowStride ] * s;
 
-                f64 value                   = sum * invRowCountMinus1;
-                rPtr[ row + j ]             = value;
-                rPtr[ j * columnCount + i ] = value;
+                for( s32 a = mr; a < GEMM_MR; ++a )
+                    packPtr[ a ] = 0;
             }
         }
-
-        return result;
     }
 
-    //algorithm comes from Rutishauser, H. Numer. Math. (1966) 9: 1. https://doi.org/10.1007/BF02165223
-    void GetEigenVectorsAndValuesJacobi( XMaths::Mf64* m, XMaths::Mf64* eigenVectors, XMaths::Vf64* eigenValues )
+    //packs rows [ k, k + kc ) and columns [ j, j + nc ) of n into GEMM_NR column micro panels,
+    //columns past nc are zero
+    template< typename T >
+    void GemmPackB( T* nPtr, s32 nRowStride, s32 kc, s32 nc, T* packPtr )
     {
-        ASSERT( m->rowCount == m->columnCount );
+        const s32 NR = Gemm< T >::NR;
 
-        s32 rowCount            = m->rowCount;
-        s32 columnCount         = m->columnCount;
+        for( s32 j = 0; j < nc; j += NR )
+        {
+            s32 nr = Utils::Min( NR, nc - j );
 
-        f64* mPtr               = m->m.base;
+            for( s32 k = 0; k < kc; ++k, packPtr += NR )
+            {
+                T* bPtr = &nPtr[ k * nRowStride + j ];
 
-        *eigenValues            = XMaths::CreateVf64( rowCount );
-        f64* valuePtr           = eigenValues->v.base;
-        *eigenVectors           = XMaths::UnitMf64( rowCount, rowCount );
-        f64* vectorPtr          = eigenVectors->m.base;
-        s32 eigenColumnCount    = rowCount;
+                for( s32 b = 0; b < nr; ++b )
+                    packPtr[ b ] = bPtr[ b ];
 
-        for( s32 i = 0; i < rowCount; ++i )
-            valuePtr[ i ] = mPtr[ i * columnCount + i ];
+                for( s32 b = nr; b < NR; ++b )
+                    packPtr[ b ] = 0;
+            }
+        }
+    }
 
-        f64 resultEpsilon = 0.0;
+    //as GemmPackB but packs rows [ k, k + kc ) and columns [ j, j + nc ) of n transposed,
+    //so rows of n become columns of the packed panel
+    template< typename T >
+    void GemmPackBTransposed( T* nPtr, s32 nRowStride, s32 kc, s32 nc, T* packPtr )
+    {
+        const s32 NR = Gemm< T >::NR;
 
-        s32 maxIterations = 50;
-        for( s32 i = 0; i < maxIterations; ++i )
+        for( s32 j = 0; j < nc; j += NR )
         {
-            f64 sum = 0.0;
+            s32 nr = Utils::Min( NR, nc - j );
 
-            for( s32 j = 0; j < rowCount - 1; ++j )
+            for( s32 b = 0; b < nr; ++b )
             {
-                for( s32 k = j + 1; k < rowCount; ++k )
-                    sum += fabs( mPtr[ j * columnCount + k ] );
+                T* bPtr = &nPtr[ ( j + b ) * nRowStride ];
+
+                for( s32 k = 0; k < kc; ++k )
+                    packPtr[ k * NR + b ] = bPtr[ k ];
             }
 
-            if( sum <= resultEpsilon )
-                return;
+            for( s32 b = nr; b < NR; ++b )
+            {
+                for( s32 k = 0; k < kc; ++k )
+                    packPtr[ k * NR + b ] = 0;
+            }
 
-            f64 rotationThreshold = 0.0;
+            packPtr += kc * NR;
+        }
+    }
 
-            s32 smallValueCutoffIteration = 4;
-            if( i < smallValueCutoffIteration )
-                rotationThreshold = ( 0.2 * sum ) / ( rowCount * rowCount );
+#ifdef XMATHS_AVX2
+    //c = a * b, or c += a * b when accumulate is set, for one GEMM_MR x NR tile
+    void GemmMicroKernel( s32 kc, f64* aPtr, f64* bPtr, f64* cPtr, s32 cColumnCount, bool accumulate )
+    {
+        __m256d c00 = _mm256_setzero_pd();
+        __m256d c01 = _mm256_setzero_pd();
+        __m256d c10 = _mm256_setzero_pd();
+        __m256d c11 = _mm256_setzero_pd();
+        __m256d c20 = _mm256_setzero_pd();
+        __m256d c21 = _mm256_setzero_pd();
+        __m256d c30 = _mm256_setzero_pd();
+        __m256d c31 = _mm256_setzero_pd();
+        __m256d c40 = _mm256_setzero_pd();
+        __m256d c41 = _mm256_setzero_pd();
+        __m256d c50 = _mm256_setzero_pd();
+        __m256d c51 = _mm256_setzero_pd();
+
+        for( s32 k = 0; k < kc; ++k, aPtr += GEMM_MR, bPtr += Gemm< f64 >::NR )
+        {
+            __m256d b0 = _mm256_load_pd( bPtr );
+            __m256d b1 = _mm256_load_pd( bPtr + 4 );
 
-            for( s32 j = 0; j < rowCount - 1; ++j )
-            {
-                for( s32 k = j + 1; k < rowCount; ++k )
-                {
-                    f64 fabsElementJK = fabs( mPtr[ j * columnCount + k ] );
-                    f64 g = 100.0 * fabsElementJK;
+            __m256d a0 = _mm256_broadcast_sd( aPtr );
+            c00 = FMADD_PD( a0, b0, c00 );
+            c01 = FMADD_PD( a0, b1, c01 );
 
-                    f64 fabsEigenValueJ = fabs( valuePtr[ j ] );
-                    f64 fabsEigenValueK = fabs( valuePtr[ k ] );
+            a0 = _mm256_broadcast_sd( aPtr + 1 );
+            c10 = FMADD_PD( a0, b0, c10 );
+            c11 = FMADD_PD( a0, b1, c11 );
 
-                    if( i > smallValueCutoffIteration
-                        && fabsEigenValueJ + g == fabsEigenValueJ
-                        && fabsEigenValueK + g == fabsEigenValueK )
-                    {
-                        mPtr[ j * columnCount + k ] = 0.0;
-                    }
-                    else if( fabsElementJK > rotationThreshold )
-                    {
-                        f64 h = valuePtr[ k ] - valuePtr[ j ];
+            a0 = _mm256_broadcast_sd( aPtr + 2 );
+            c20 = FMADD_PD( a0, b0, c20 );
+            c21 = FMADD_PD( a0, b1, c21 );
 
-                        f64 t = 0;
+            a0 = _mm256_broadcast_sd( aPtr + 3 );
+            c30 = FMADD_PD( a0, b0, c30 );
+            c31 = FMADD_PD( a0, b1, c31 );
 
-                        f64 fabsH = fabs( h );
-                        if( fabsH + g == fabsH )
-                        {
-                            t = mPtr[ j * columnCount + k ] / h;
-                        }
-                        else
-                        {
-                            f64 theta = 0.5 * h / mPtr[ j * columnCount + k ];
-                            t = 1.0 / ( fabs( theta ) + sqrt( 1 + theta * theta ) );
+            a0 = _mm256_broadcast_sd( aPtr + 4 );
+            c40 = FMADD_PD( a0, b0, c40 );
+            c41 = FMADD_PD( a0, b1, c41 );
 
-                            if( theta < 0.0 )
-                                t = -t;
-                        }
+            a0 = _mm256_broadcast_sd( aPtr + 5 );
+            c50 = FMADD_PD( a0, b0, c50 );
+            c51 = FMADD_PD( a0, b1, c51 );
+        }
 
-                        f64 c   = 1 / sqrt( 1 + t * t );
-                        f64 s   = t * c;
-                        f64 tau = s / ( 1 + c );
+        __m256d c[ GEMM_MR * 2 ] = { c00, c01, c10, c11, c20, c21, c30, c31, c40, c41, c50, c51 };
 
-                        h = t * mPtr[ j * columnCount + k ];
+        for( s32 a = 0; a < GEMM_MR; ++a, cPtr += cColumnCount )
+        {
+            __m256d r0 = c[ a * 2 ];
+            __m256d r1 = c[ a * 2 + 1 ];
 
-                        valuePtr[ j ] -= h;
-                        valuePtr[ k ] += h;
+            if( accumulate )
+            {
+                r0 = _mm256_add_pd( r0, _mm256_loadu_pd( cPtr ) );
+                r1 = _mm256_add_pd( r1, _mm256_loadu_pd( cPtr + 4 ) );
+            }
 
-                        mPtr[ j * columnCount + k ] = 0.0;
+            _mm256_storeu_pd( cPtr, r0 );
+            _mm256_storeu_pd( cPtr + 4, r1 );
+        }
+    }
 
-                        for( s32 x = 0; x < j; ++x )
-                        {
-                            g = mPtr[ x * columnCount + j ];
-                            h = mPtr[ x * columnCount + k ];
+    void GemmMicroKernel( s32 kc, f32* aPtr, f32* bPtr, f32* cPtr, s32 cColumnCount, bool accumulate )
+    {
+        __m256 c00 = _mm256_setzero_ps();
+        __m256 c01 = _mm256_setzero_ps();
+        __m256 c10 = _mm256_setzero_ps();
+        __m256 c11 = _mm256_setzero_ps();
+        __m256 c20 = _mm256_setzero_ps();
+        __m256 c21 = _mm256_setzero_ps();
+        __m256 c30 = _mm256_setzero_ps();
+        __m256 c31 = _mm256_setzero_ps();
+        __m256 c40 = _mm256_setzero_ps();
+        __m256 c41 = _mm256_setzero_ps();
+        __m256 c50 = _mm256_setzero_ps();
+        __m256 c51 = _mm256_setzero_ps();
+
+        for( s32 k = 0; k < kc; ++k, aPtr += GEMM_MR, bPtr += Gemm< f32 >::NR )
+        {
+            __m256 b0 = _mm256_load_ps( bPtr );
+            __m256 b1 = _mm256_load_ps( bPtr + 8 );
 
-                            mPtr[ x * columnCount + j ] = g - s * ( h + g * tau );
-                            mPtr[ x * columnCount + k ] = h + s * ( g - h * tau );
-                        }
+            __m256 a0 = _mm256_broadcast_ss( aPtr );
+            c00 = FMADD_PS( a0, b0, c00 );
+            c01 = FMADD_PS( a0, b1, c01 );
 
-                        for( s32 x = j + 1; x < k; ++x )
-                        {
-                            g = mPtr[ j * columnCount + x ];
-                            h = mPtr[ x * columnCount + k ];
+            a0 = _mm256_broadcast_ss( aPtr + 1 );
+            c10 = FMADD_PS( a0, b0, c10 );
+            c11 = FMADD_PS( a0, b1, c11 );
 
-                            mPtr[ j * columnCount + x ] = g - s * ( h + g * tau );
-                            mPtr[ x * columnCount + k ] = h + s * ( g - h * tau );
-                        }
+            a0 = _mm256_broadcast_ss( aPtr + 2 );
+            c20 = FMADD_PS( a0, b0, c20 );
+            c21 = FMADD_PS( a0, b1, c21 );
 
-                        for( s32 x = k + 1; x < rowCount; ++x )
-                        {
-                            g = mPtr[ j * columnCount + x ];
-                            h = mPtr[ k * columnCount + x ];
+            a0 = _mm256_broadcast_ss( aPtr + 3 );
+            c30 = FMADD_PS( a0, b0, c30 );
+            c31 = FMADD_PS( a0, b1, c31 );
 
-                            mPtr[ j * columnCount + x ] = g - s * ( h + g * tau );
-                            mPtr[ k * columnCount + x ] = h + s * ( g - h * tau );
-                        }
+            a0 = _mm256_broadcast_ss( aPtr + 4 );
+            c40 = FMADD_PS( a0, b0, c40 );
+            c41 = FMADD_PS( a0, b1, c41 );
 
-                        for( s32 x = 0; x < rowCount; ++x )
-                        {
-                            g = vectorPtr[ x * eigenColumnCount + j ];
-                            h = vectorPtr[ x * eigenColumnCount + k ];
+            a0 = _mm256_broadcast_ss( aPtr + 5 );
+            c50 = FMADD_PS( a0, b0, c50 );
+            c51 = FMADD_PS( a0, b1, c51 );
+        }
 
-                            vectorPtr[ x * eigenColumnCount + j ] = g - s * ( h + g * tau );
-                            vectorPtr[ x * eigenColumnCount + k ] = h + s * ( g - h * tau );
-                        }
-                    }
-                }
+        __m256 c[ GEMM_MR * 2 ] = { c00, c01, c10, c11, c20, c21, c30, c31, c40, c41, c50, c51 };
+
+        for( s32 a = 0; a < GEMM_MR; ++a, cPtr += cColumnCount )
+        {
+            __m256 r0 = c[ a * 2 ];
+            __m256 r1 = c[ a * 2 + 1 ];
+
+            if( accumulate )
+            {
+                r0 = _mm256_add_ps( r0, _mm256_loadu_ps( cPtr ) );
+                r1 = _mm256_add_ps( r1, _mm256_loadu_ps( cPtr + 8 ) );
             }
+
+            _mm256_storeu_ps( cPtr, r0 );
+            _mm256_storeu_ps( cPtr + 8, r1 );
         }
     }
-
-    void SortEigenVectorsAndValues( XMaths::Mf64* eigenVectors, XMaths::Vf64* eigenValues )
+#else
+    template< typename T >
+    void GemmMicroKernel( s32 kc, T* aPtr, T* bPtr, T* cPtr, s32 cColumnCount, bool accumulate )
     {
-        s32 count       = eigenValues->count;
+        const s32 NR = Gemm< T >::NR;
 
-        f64* vectorPtr  = eigenVectors->m.base;
-        f64* valuePtr   = eigenValues->v.base;
+        T c[ GEMM_MR * NR ] = {};
 
-        if( count <= 2 )
-            return;
+        for( s32 k = 0; k < kc; ++k, aPtr += GEMM_MR, bPtr += NR )
+        {
+            for( s32 a = 0; a < GEMM_MR; ++a )
+            {
+                T element = aPtr[ a ];
+                for( s32 b = 0; b < NR; ++b )
+                    c[ a * NR + b ] += element * bPtr[ b ];
+            }
+        }
 
-        for( s32 i = 0; i < count - 1; ++i )
+        for( s32 a = 0; a < GEMM_MR; ++a, cPtr += cColumnCount )
         {
-            s32 k = i;
-            f64 p = valuePtr[ i ];
+            for( s32 b = 0; b < NR; ++b )
+                cPtr[ b ] = accumulate ? cPtr[ b ] + c[ a * NR + b ] : c[ a * NR + b ];
+        }
+    }
+#endif
 
-            for( s32 j = i + 1; j < count; ++j )
+    //with lower set only the micro tiles reaching the diagonal or below it are computed, diagonalOffset being
+    //how far the block's first row is below the diagonal row of its first column
+    template< typename T >
+    void GemmMacroKernel( s32 mc, s32 nc, s32 kc, T* packA, T* packB, T* cPtr, s32 cColumnCount, bool accumulate,
+                          bool lower = false, s32 diagonalOffset = 0 )
+    {
+        const s32 NR = Gemm< T >::NR;
+
+        ALIGN_32 T edge[ GEMM_MR * NR ];
+
+        for( s32 j = 0; j < nc; j += NR )
+        {
+            s32 nr      = Utils::Min( NR, nc - j );
+            T* bPtr     = &packB[ j * kc ];
+
+            for( s32 i = 0; i < mc; i += GEMM_MR )
             {
-                if( valuePtr[ j ] >= p )
+                s32 mr      = Utils::Min( GEMM_MR, mc - i );
+                if( lower && j >= i + mr + diagonalOffset )
+                    continue;
+
+                T* aPtr     = &packA[ i * kc ];
+                T* rPtr     = &cPtr[ i * cColumnCount + j ];
+
+                if( mr == GEMM_MR && nr == NR )
                 {
-                    k = j;
-                    p = valuePtr[ j ];
+                    GemmMicroKernel( kc, aPtr, bPtr, rPtr, cColumnCount, accumulate );
+                }
+                else
+                {
+                    GemmMicroKernel( kc, aPtr, bPtr, edge, NR, false );
+
+                    for( s32 a = 0; a < mr; ++a, rPtr += cColumnCount )
+                    {
+                        for( s32 b = 0; b < nr; ++b )
+                            rPtr[ b ] = accumulate ? rPtr[ b ] + edge[ a * NR + b ] : edge[ a * NR + b ];
+                    }
                 }
             }
+        }
+    }
 
-            if( k != i )
+
+    template< typename T >
+    struct MultiplyBlockData
+    {
+        s32 rowStart;
+        s32 rowEndPlus1;
+        s32 columnStart;
+        s32 columnEndPlus1;
+
+        //column k of m is scaled by scale * kScale[ k ]
+        T* kScale;
+        T scale;
+
+        //when kCount is set only kCount columns of m from kStart on are used, against the same rows of n,
+        //and accumulate adds the product to result instead of overwriting it
+        s32 kStart;
+        s32 kCount;
+        bool accumulate;
+
+        //when set only the lower triangle of a square result is needed, and blocks and tiles wholly above it are skipped
+        bool lower;
+
+        //when set the block is finished as a squared distance, rowNorms[ i ] + columnNorms[ j ] - 2 * result
+        T* rowNorms;
+        T* columnNorms;
+
+        //result holds columns from rColumnStart on, so a caller can pass in just a column range of it
+        s32 rColumnCount;
+        s32 rColumnStart;
+        T* result;
+        XMaths::MatrixView< T > m;
+        XMaths::MatrixView< T > n;
+    };
+
+
+    template< typename T >
+    void MultiplyBlock( s32 threadIndex, void* data )
+    {
+        MultiplyBlockData< T >* multiplyBlockData = ( MultiplyBlockData< T >* ) data;
+
+        s32 rowStart            = multiplyBlockData->rowStart;
+        s32 rowEndPlus1         = multiplyBlockData->rowEndPlus1;
+        s32 columnStart         = multiplyBlockData->columnStart;
+        s32 columnEndPlus1      = multiplyBlockData->columnEndPlus1;
+
+        T* kScale               = multiplyBlockData->kScale;
+        T scale                 = multiplyBlockData->scale;
+
+        s32 kStart              = multiplyBlockData->kStart;
+        s32 kCount              = multiplyBlockData->kCount;
+        bool accumulate         = multiplyBlockData->accumulate;
+
+        bool lower              = multiplyBlockData->lower;
+
+        T* rowNorms             = multiplyBlockData->rowNorms;
+        T* columnNorms          = multiplyBlockData->columnNorms;
+
+        s32 rColumnCount        = multiplyBlockData->rColumnCount;
+        s32 rColumnStart        = multiplyBlockData->rColumnStart;
+        T* rArrayPtr            = multiplyBlockData->result;
+        XMaths::MatrixView< T > m   = multiplyBlockData->m;
+        T* mArrayPtr                = m.base;
+        XMaths::MatrixView< T > n   = multiplyBlockData->n;
+        T* nArrayPtr                = n.base;
+        s32 nRowStride              = n.rowStride;
+
+        T* packA                = ( T* ) gemmPackA[ threadIndex ];
+        T* packB                = ( T* ) gemmPackB[ threadIndex ];
+
+        s32 mRowStride          = m.transposed ? 1 : m.rowStride;
+        s32 mColumnStride       = m.transposed ? m.rowStride : 1;
+
+        if( kCount == 0 )
+            kCount = m.columnCount - kStart;
+
+        s32 kEndPlus1           = kStart + kCount;
+
+        for( s32 j = columnStart; j < columnEndPlus1; j += GEMM_NC )
+        {
+            s32 nc = Utils::Min( GEMM_NC, columnEndPlus1 - j );
+
+            for( s32 k = kStart; k < kEndPlus1; k += GEMM_KC )
             {
-                valuePtr[ k ] = valuePtr[ i ];
-                valuePtr[ i ] = p;
+                s32 kc = Utils::Min( GEMM_KC, kEndPlus1 - k );
 
-                for( s32 j = 0; j < count; ++j )
+                if( n.transposed )
+                    GemmPackBTransposed( &nArrayPtr[ j * nRowStride + k ], nRowStride, kc, nc, packB );
+                else
+                    GemmPackB( &nArrayPtr[ k * nRowStride + j ], nRowStride, kc, nc, packB );
+
+                for( s32 i = rowStart; i < rowEndPlus1; i += GEMM_MC )
                 {
-                    s32 row = j * count;
-                    p = vectorPtr[ row + i ];
-                    vectorPtr[ row + i ] = vectorPtr[ row + k ];
-                    vectorPtr[ row + k ] = p;
+                    s32 mc = Utils::Min( GEMM_MC, rowEndPlus1 - i );
+                    if( lower && j >= i + mc )
+                        continue;
+
+                    GemmPackA( &mArrayPtr[ i * mRowStride + k * mColumnStride ], mRowStride, mColumnStride, mc, kc,
+                               kScale ? &kScale[ k ] : 0, scale, packA );
+                    GemmMacroKernel( mc, nc, kc, packA, packB, &rArrayPtr[ i * rColumnCount + j - rColumnStart ], rColumnCount, accumulate || k > kStart,
+                                     lower, i - j );
+                }
+            }
+
+            if( rowNorms )
+            {
+                for( s32 i = rowStart; i < rowEndPlus1; ++i )
+                {
+                    T* rPtr         = &rArrayPtr[ i * rColumnCount + j - rColumnStart ];
+                    T rowNorm       = rowNorms[ i ];
+
+                    //cancellation can leave tiny negatives for near identical rows
+                    for( s32 b = 0; b < nc; ++b )
+                    {
+                        T distance  = rowNorm + columnNorms[ j + b ] - 2 * rPtr[ b ];
+                        rPtr[ b ]   = distance > 0 ? distance : 0;
+                    }
                 }
             }
         }
     }
-}
 
+    //the blocks of one Multiply, the block ranges come from the block index; when k is split the job index also
+    //picks a slice of k, slice 0 writing into the result and each later one into its own partial product
+    struct MultiplyData
+    {
+        MultiplyBlockData< f64 > block;
 
-namespace XMaths
-{
-    s32 ArrayProduct( s32* array, s32 count )
+        s32 rowCount;
+        s32 columnCount;
+        s32 iJumpCount;
+        s32 columnBlockCount;
+        s32 blockCount;
+
+        s32 kCount;
+        s32 kSliceCount;
+        s32 kSliceLength;
+        f64* partials;
+    };
+
+
+    void MultiplyBlocks( s32 threadIndex, s32 startIndex, s32 endIndexPlus1, void* data )
     {
-        ASSERT( count > 0 );
+        MultiplyData* multiplyData          = ( MultiplyData* ) data;
+        MultiplyBlockData< f64 > blockData  = multiplyData->block;
 
-        s32 result = array[ 0 ];
-        for( s32 i = 1; i < count; ++i )
-            result *= array[ i ];
-        return result;
+        s32 iJumpCount                      = multiplyData->iJumpCount;
+        s32 columnBlockCount                = multiplyData->columnBlockCount;
+        s32 blockCount                      = multiplyData->blockCount;
+        s32 kSliceLength                    = multiplyData->kSliceLength;
+
+        for( s32 index = startIndex; index < endIndexPlus1; ++index )
+        {
+            s32 slice   = index / blockCount;
+            s32 b       = index % blockCount;
+
+            s32 i = ( b / columnBlockCount ) * iJumpCount;
+            s32 j = ( b % columnBlockCount ) * GEMM_NC;
+
+            blockData.rowStart          = i;
+            blockData.rowEndPlus1       = Utils::Min( i + iJumpCount, multiplyData->rowCount );
+            blockData.columnStart       = j;
+            blockData.columnEndPlus1    = Utils::Min( j + GEMM_NC, multiplyData->columnCount );
+
+            if( blockData.lower )
+            {
+                blockData.columnEndPlus1 = Utils::Min( blockData.columnEndPlus1, blockData.rowEndPlus1 );
+                if( j >= blockData.columnEndPlus1 )
+                    continue;
+            }
+
+            if( multiplyData->kSliceCount > 1 )
+            {
+                blockData.kStart    = slice * kSliceLength;
+                blockData.kCount    = Utils::Min( kSliceLength, multiplyData->kCount - blockData.kStart );
+
+                blockData.accumulate    = slice > 0 ? false : multiplyData->block.accumulate;
+                blockData.rColumnCount  = slice > 0 ? multiplyData->columnCount : multiplyData->block.rColumnCount;
+                blockData.result        = slice > 0 ? &multiplyData->partials[ ( s64 ) ( slice - 1 ) * multiplyData->rowCount * multiplyData->columnCount ]
+                                                    : multiplyData->block.result;
+            }
+
+            MultiplyBlock< f64 >( threadIndex, &blockData );
+        }
     }
 
+    //adds the partial products of the later k slices onto the result, in slice order
+    void SumPartials( s32 threadIndex, s32 startIndex, s32 endIndexPlus1, void* data )
+    {
+        MultiplyData* multiplyData  = ( MultiplyData* ) data;
+
+        s32 columnCount             = multiplyData->columnCount;
+        s32 rColumnCount            = multiplyData->block.rColumnCount;
+        s64 partialCount            = ( s64 ) multiplyData->rowCount * columnCount;
 
-    Vf64 CreateVf64( s32 count )
+        for( s32 i = startIndex; i < endIndexPlus1; ++i )
+        {
+            f64* rPtr   = &multiplyData->block.result[ i * rColumnCount ];
+            s32 jCount  = multiplyData->block.lower ? i + 1 : columnCount;
+
+            for( s32 slice = 1; slice < multiplyData->kSliceCount; ++slice )
+            {
+                f64* pPtr = &multiplyData->partials[ ( slice - 1 ) * partialCount + i * columnCount ];
+                for( s32 j = 0; j < jCount; ++j )
+                    rPtr[ j ] += pPtr[ j ];
+            }
+        }
+    }
+
+    //result = m * diag( kScale ) * scale * n with kScale optional, written with a row stride of rColumnCount; a product with too few row and column blocks to go round
+    //the threads, like FI^T * RT, also splits the long inner dimension and adds the partial products up afterwards;
+    //lower only writes the lower triangle of a square result, entries above it get the product or are left alone,
+    //and accumulate adds the product onto result rather than overwriting it
+    void Multiply( XMaths::Mf64View m, f64* kScale, f64 scale, XMaths::Mf64View n,
+                   f64* result, s32 rColumnCount, f64* rowNorms, f64* columnNorms, bool lower = false, bool accumulate = false )
     {
-        Vf64 result = { count, Array< f64 >( count, CACHE_LINE_SIZE ) };
-        return result;
+        ASSERT( m.columnCount == n.rowCount );
+
+        s32 rowCount        = m.rowCount;
+        s32 nColumnCount    = n.columnCount;
+
+        CreateGemmPackBuffers();
+
+        s32 processorCount      = Platform::GetProcessorCount();
+        s32 kCount              = m.columnCount;
+        s32 columnBlockCount    = ( nColumnCount - 1 ) / GEMM_NC + 1;
+
+        //rows are split between the threads first, down to GEMM_MR each
+        s32 iJumpCount          = ( rowCount - 1 ) / processorCount + 1;
+        iJumpCount              = ( ( iJumpCount - 1 ) / GEMM_MR + 1 ) * GEMM_MR;
+        iJumpCount              = Utils::Min( iJumpCount, GEMM_MC );
+        s32 blockCount          = ( ( rowCount - 1 ) / iJumpCount + 1 ) * columnBlockCount;
+
+        //a short result, like FI^T * RT, keeps its rows whole and splits k instead when that makes more jobs; slices
+        //are whole GEMM_KC panels each with enough work to be worth a job, and the squared distance finish needs the
+        //whole sum so distances are never split
+        s32 kSliceCount         = 1;
+        s32 kSliceLength        = kCount;
+
+        if( !rowNorms && blockCount < processorCount )
+        {
+            s32 wholeJumpCount      = Utils::Min( ( ( rowCount - 1 ) / GEMM_MR + 1 ) * GEMM_MR, GEMM_MC );
+            s32 wholeBlockCount     = ( ( rowCount - 1 ) / wholeJumpCount + 1 ) * columnBlockCount;
+
+            s32 minSliceLength      = ( ( Platform::GetGrain( ( s64 ) rowCount * nColumnCount ) - 1 ) / GEMM_KC + 1 ) * GEMM_KC;
+            s32 sliceCount          = Utils::Min( processorCount / wholeBlockCount, ( kCount - 1 ) / minSliceLength + 1 );
+            s32 panelCount          = ( kCount - 1 ) / GEMM_KC + 1;
+
+            if( sliceCount > 1 && sliceCount * wholeBlockCount > blockCount )
+            {
+                kSliceLength    = ( ( panelCount - 1 ) / sliceCount + 1 ) * GEMM_KC;
+                kSliceCount     = ( kCount - 1 ) / kSliceLength + 1;
+
+                iJumpCount      = wholeJumpCount;
+                blockCount      = wholeBlockCount;
+            }
+        }
+
+        MultiplyData data = {};
+        data.block.kScale           = kScale;
+        data.block.scale            = scale;
+
+        data.block.lower            = lower;
+        data.block.accumulate       = accumulate;
+
+        data.block.rowNorms         = rowNorms;
+        data.block.columnNorms      = columnNorms;
+
+        data.block.rColumnCount     = rColumnCount;
+        data.block.result           = result;
+        data.block.m                = m;
+        data.block.n                = n;
+
+        data.rowCount               = rowCount;
+        data.columnCount            = nColumnCount;
+        data.iJumpCount             = iJumpCount;
+        data.columnBlockCount       = columnBlockCount;
+        data.blockCount             = blockCount;
+
+        data.kCount                 = kCount;
+        data.kSliceCount            = kSliceCount;
+        data.kSliceLength           = kSliceLength;
+
+        if( data.kSliceCount > 1 )
+        {
+            WORKSPACE_MEMORY();
+            data.partials = ( f64* ) workspace.Push( sizeof( f64 ) * ( data.kSliceCount - 1 ) * ( s64 ) rowCount * nColumnCount );
+
+            Platform::ParallelFor( data.blockCount * data.kSliceCount, 1, MultiplyBlocks, &data );
+            Platform::ParallelFor( rowCount, Platform::GetGrain( ( s64 ) nColumnCount * ( data.kSliceCount - 1 ) ), SumPartials, &data );
+        }
+        else
+        {
+            Platform::ParallelFor( data.blockCount, 1, MultiplyBlocks, &data );
+        }
     }
 
-    void SqrtEquals( Vf64* v )
+
+    //squared distance between two vector aligned rows over count columns, a whole number of vectors, so rows of whole
+    //matrices can be summed across their zero padding with aligned loads and no remainder loop; the lanes are added
+    //up in the same order on both paths
+    f64 PaddedSquaredDistance( f64* mPtr, f64* nPtr, s32 count )
     {
-        s32 count = v->count;
-        f64* vPtr = v->v.base;
+        ASSERT( count % 4 == 0 );
+        ASSERT_ALIGNED_TO( mPtr, XMaths::MATRIX_ROW_ALIGNMENT );
+        ASSERT_ALIGNED_TO( nPtr, XMaths::MATRIX_ROW_ALIGNMENT );
 
-        for( s32 i = 0; i < count; ++i )
-            vPtr[ i ] = sqrt( vPtr[ i ] );
+        ALIGN_32 f64 lanes[ 4 ];
+
+#ifdef XMATHS_AVX2
+        __m256d sum = _mm256_setzero_pd();
+        for( s32 c = 0; c < count; c += 4 )
+        {
+            __m256d diff    = _mm256_sub_pd( _mm256_load_pd( &mPtr[ c ] ), _mm256_load_pd( &nPtr[ c ] ) );
+            sum             = FMADD_PD( diff, diff, sum );
+        }
+
+        _mm256_store_pd( lanes, sum );
+#else
+        for( s32 a = 0; a < 4; ++a )
+            lanes[ a ] = 0;
+
+        for( s32 c = 0; c < count; c += 4 )
+        {
+            for( s32 a = 0; a < 4; ++a )
+            {
+                f64 diff    = mPtr[ c + a ] - nPtr[ c + a ];
+                lanes[ a ]  = FMADD( diff, diff, lanes[ a ] );
+            }
+        }
+#endif
+
+        return ( lanes[ 0 ] + lanes[ 1 ] ) + ( lanes[ 2 ] + lanes[ 3 ] );
     }
 
-    f64 GetMean( Vf64* v )
+    f32 PaddedSquaredDistance( f32* mPtr, f32* nPtr, s32 count )
     {
-        f64 result = 0;
+        ASSERT( count % 8 == 0 );
+        ASSERT_ALIGNED_TO( mPtr, XMaths::MATRIX_ROW_ALIGNMENT );
+        ASSERT_ALIGNED_TO( nPtr, XMaths::MATRIX_ROW_ALIGNMENT );
 
-        s32 count = v->count;
-        f64* vPtr = v->v.base;
+        ALIGN_32 f32 lanes[ 8 ];
 
-        for( s32 i = 0; i < count; ++i )
-            result += vPtr[ i ];
+#ifdef XMATHS_AVX2
+        __m256 sum = _mm256_setzero_ps();
+        for( s32 c = 0; c < count; c += 8 )
+        {
+            __m256 diff = _mm256_sub_ps( _mm256_load_ps( &mPtr[ c ] ), _mm256_load_ps( &nPtr[ c ] ) );
+            sum         = FMADD_PS( diff, diff, sum );
+        }
 
-        result /= ( f64 ) count;
+        _mm256_store_ps( lanes, sum );
+#else
+        for( s32 a = 0; a < 8; ++a )
+            lanes[ a ] = 0;
 
-        return result;
+        for( s32 c = 0; c < count; c += 8 )
+        {
+            for( s32 a = 0; a < 8; ++a )
+            {
+                f32 diff    = mPtr[ c + a ] - nPtr[ c + a ];
+                lanes[ a ]  = FMADDF( diff, diff, lanes[ a ] );
+            }
+        }
+#endif
+
+        return ( ( lanes[ 0 ] + lanes[ 1 ] ) + ( lanes[ 2 ] + lanes[ 3 ] ) ) + ( ( lanes[ 4 ] + lanes[ 5 ] ) + ( lanes[ 6 ] + lanes[ 7 ] ) );
     }
 
 
-    void Mf64::operator += ( const Mf64 &n )
+    struct DistanceBlockData
     {
-        ASSERT( rowCount == n.rowCount );
-        ASSERT( columnCount == n.columnCount );
+        s32 startIndex;
+        s32 endIndexPlus1;
+
+        //columnCount is the number of dimensions, the row strides step through the rows of m and n;
+        //when padded m and n are whole matrices and columnCount takes in their padding
+        s32 rColumnCount;
+        s32 columnCount;
+        s32 mRowStride;
+        s32 nRowStride;
+        bool padded;
+
+        s32 iJumpCount;
+        s32 jJumpCount;
+
+        s32 indexR;
+        s32 indexN;
+
+        XMaths::Mf64* result;
+        f64* m;
+        f64* n;
+    };
+
+
+    void Mf64DistanceBlock( s32 threadIndex, void* data )
+    {
+        DistanceBlockData* distanceBlockData = ( DistanceBlockData* ) data;
+
+        s32 startIndex          = distanceBlockData->startIndex;
+        s32 endIndexPlus1       = distanceBlockData->endIndexPlus1;
+
+        s32 rColumnCount        = distanceBlockData->rColumnCount;
+        s32 columnCount         = distanceBlockData->columnCount;
+        s32 mRowStride          = distanceBlockData->mRowStride;
+        s32 nRowStride          = distanceBlockData->nRowStride;
+        bool padded             = distanceBlockData->padded;
+
+        s32 iJumpCount          = distanceBlockData->iJumpCount;
+        s32 jJumpCount          = distanceBlockData->jJumpCount;
+
+        s32 indexR              = distanceBlockData->indexR;
+        s32 indexN              = distanceBlockData->indexN;
+
+        XMaths::Mf64* result    = distanceBlockData->result;
+        f64* rArrayPtr          = result->m.base;
+        f64* mArrayPtr          = distanceBlockData->m;
+        f64* nArrayPtr          = distanceBlockData->n;
+
+        for( s32 j = startIndex; j < endIndexPlus1; j += jJumpCount )
+        {
+            jJumpCount      = Utils::Min( jJumpCount, endIndexPlus1 - j );
+            s32 kJumpCount  = F64_PER_CACHE_LINE * 32;
+            kJumpCount      = Utils::Min( kJumpCount, columnCount );
+
+            s32 indexM      = j * mRowStride;
+
+            f64* rPtr       = &rArrayPtr[ indexR + j ];
+            f64* nPtr       = &nArrayPtr[ indexN ];
+
+            for( s32 a = 0; a < iJumpCount; ++a, rPtr += rColumnCount, nPtr += nRowStride )
+            {
+                f64* mPtr = &mArrayPtr[ indexM ];
+
+                for( s32 b = 0; b < jJumpCount; ++b, mPtr += mRowStride )
+                {
+                    if( padded )
+                    {
+                        rPtr[ b ] = PaddedSquaredDistance( mPtr, nPtr, kJumpCount );
+                        continue;
+                    }
+
+                    f64 sum = 0;
+                    for( s32 c = 0; c < kJumpCount; ++c )
+                    {
+                        f64 diff    = mPtr[ c ] - nPtr[ c ];
+                        sum         += diff * diff;
+                    }
+
+                    rPtr[ b ] = sum;
+                }
+            }
+
+            for( s32 k = kJumpCount; k < columnCount; k += kJumpCount )
+            {
+                kJumpCount  = Utils::Min( kJumpCount, columnCount - k );
+
+                rPtr        = &rArrayPtr[ indexR + j ];
+                nPtr        = &nArrayPtr[ indexN + k ];
+
+                for( s32 a = 0; a < iJumpCount; ++a, rPtr += rColumnCount, nPtr += nRowStride )
+                {
+                    f64* mPtr = &mArrayPtr[ indexM + k ];
+
+                    for( s32 b = 0; b < jJumpCount; ++b, mPtr += mRowStride )
+                    {
+                        if( padded )
+                        {
+                            rPtr[ b ] += PaddedSquaredDistance( mPtr, nPtr, kJumpCount );
+                            continue;
+                        }
+
+                        f64 sum = 0;
+                        for( s32 c = 0; c < kJumpCount; ++c )
+                        {
+                            f64 diff    = mPtr[ c ] - nPtr[ c ];
+                            sum         += diff * diff;
+                        }
+
+                        rPtr[ b ] += sum;
+                    }
+                }
+            }
+        }
+    }
+
+    //the blocks of the direct Distance, the block ranges come from the block index
+    struct DistanceData
+    {
+        DistanceBlockData block;
+
+        s32 mRowCount;
+        s32 nRowCount;
+        s32 iJumpCount;
+        s32 blockJumpCount;
+        s32 jBlockCount;
+    };
+
+
+    void Mf64DistanceBlocks( s32 threadIndex, s32 startIndex, s32 endIndexPlus1, void* data )
+    {
+        DistanceData* distanceData      = ( DistanceData* ) data;
+        DistanceBlockData blockData     = distanceData->block;
+
+        s32 iJumpCount                  = distanceData->iJumpCount;
+        s32 blockJumpCount              = distanceData->blockJumpCount;
+        s32 jBlockCount                 = distanceData->jBlockCount;
+
+        for( s32 b = startIndex; b < endIndexPlus1; ++b )
+        {
+            s32 i = ( b / jBlockCount ) * iJumpCount;
+            s32 j = ( b % jBlockCount ) * blockJumpCount;
+
+            blockData.startIndex    = j;
+            blockData.endIndexPlus1 = Utils::Min( j + blockJumpCount, distanceData->mRowCount );
+
+            blockData.iJumpCount    = Utils::Min( iJumpCount, distanceData->nRowCount - i );
+
+            blockData.indexR        = i * blockData.rColumnCount;
+            blockData.indexN        = i * blockData.nRowStride;
+
+            Mf64DistanceBlock( threadIndex, &blockData );
+        }
+    }
+
+    //Distance, padded as in DistanceBlockData
+    void DistanceViews( XMaths::Mf64View m, XMaths::Mf64View n, XMaths::Mf64* result, XMaths::Vf64* mSquaredNorms,
+                        XMaths::DistanceMode mode, bool padded )
+    {
+        s32 rColumnCount    = result->rowStride;
+        s32 mRowCount       = m.rowCount;
+        s32 nRowCount       = n.rowCount;
+        s32 columnCount     = n.columnCount;
+
+        ASSERT( nRowCount <= result->rowCount );
+        ASSERT( mRowCount <= result->columnCount );
+        ASSERT( !padded || m.rowStride == n.rowStride );
+        ASSERT( m.columnCount == columnCount );
+        ASSERT( !mSquaredNorms || mSquaredNorms->count == mRowCount );
+
+        if( mode == XMaths::DistanceMode_Auto )
+            mode = columnCount >= XMaths::DISTANCE_GEMM_MIN_DIMENSIONS ? XMaths::DistanceMode_Gemm : XMaths::DistanceMode_Direct;
+
+        if( mode == XMaths::DistanceMode_Gemm && columnCount > 0 )
+        {
+            XMaths::Vf64 mNorms = mSquaredNorms ? *mSquaredNorms : XMaths::GetSquaredRowNorms( m );
+            XMaths::Vf64 nNorms = XMaths::GetSquaredRowNorms( n );
+
+            Multiply( n, 0, 1, XMaths::TransposedView( m ), result->m.base, rColumnCount, nNorms.v.base, mNorms.v.base );
+            return;
+        }
+
+        ASSERT( !m.transposed && !n.transposed );
+
+        s32 iJumpCount      = F64_PER_CACHE_LINE * 32;
+        s32 jJumpStartCount = F64_PER_CACHE_LINE;
+        s32 blockJumpCount  = ( ( mRowCount - 1 ) / jJumpStartCount ) / Platform::GetProcessorCount() + 1;
+        blockJumpCount      = Utils::Max( blockJumpCount, jJumpStartCount );
+
+        if( nRowCount == 0 || mRowCount == 0 )
+            return;
+
+        DistanceData data = {};
+        data.block.rColumnCount = rColumnCount;
+        data.block.columnCount  = padded ? XMaths::GetRowStride< f64 >( columnCount ) : columnCount;
+        data.block.mRowStride   = m.rowStride;
+        data.block.nRowStride   = n.rowStride;
+        data.block.padded       = padded;
+
+        data.block.jJumpCount   = jJumpStartCount;
+
+        data.block.result       = result;
+        data.block.m            = m.base;
+        data.block.n            = n.base;
+
+        data.mRowCount          = mRowCount;
+        data.nRowCount          = nRowCount;
+        data.iJumpCount         = iJumpCount;
+        data.blockJumpCount     = blockJumpCount;
+        data.jBlockCount        = ( mRowCount - 1 ) / blockJumpCount + 1;
+
+        s32 blockCount = ( ( nRowCount - 1 ) / iJumpCount + 1 ) * data.jBlockCount;
+        Platform::ParallelFor( blockCount, 1, Mf64DistanceBlocks, &data );
+    }
+
+    template< typename T >
+    void SquaredRowNorms( XMaths::MatrixView< T > m, XMaths::Vector< T >* result )
+    {
+        s32 rowCount        = m.rowCount;
+        s32 columnCount     = m.columnCount;
+        s32 rowStride       = m.transposed ? 1 : m.rowStride;
+        s32 columnStride    = m.transposed ? m.rowStride : 1;
+
+        T* rArrayPtr        = result->v.base;
+
+        for( s32 i = 0; i < rowCount; ++i )
+        {
+            T* mPtr = &m.base[ i * rowStride ];
+
+            T sum = 0;
+            for( s32 j = 0; j < columnCount; ++j )
+                sum += mPtr[ j * columnStride ] * mPtr[ j * columnStride ];
+
+            rArrayPtr[ i ] = sum;
+        }
+    }
+
+    //serial bodies of DistanceRange and MultiplyAccumulateRange for either precision, padded as in DistanceBlockData
+    template< typename T >
+    void DistanceRows( s32 threadIndex, XMaths::MatrixView< T > m, s32 mStart, s32 mEndPlus1, XMaths::MatrixView< T > n, T* result, s32 rColumnCount,
+                       XMaths::Vector< T >* mSquaredNorms, XMaths::Vector< T >* nSquaredNorms, XMaths::DistanceMode mode, bool padded )
+    {
+        s32 nRowCount       = n.rowCount;
+        s32 columnCount     = n.columnCount;
+
+        ASSERT( mStart >= 0 && mStart <= mEndPlus1 && mEndPlus1 <= m.rowCount );
+        ASSERT( m.columnCount == columnCount );
+
+        if( mode == XMaths::DistanceMode_Auto )
+            mode = columnCount >= XMaths::DISTANCE_GEMM_MIN_DIMENSIONS ? XMaths::DistanceMode_Gemm : XMaths::DistanceMode_Direct;
+
+        if( mode == XMaths::DistanceMode_Gemm && mSquaredNorms && nSquaredNorms && columnCount > 0 )
+        {
+            ASSERT( threadIndex < gemmPackBufferCount );
+
+            MultiplyBlockData< T > data = {};
+            data.rowStart               = 0;
+            data.rowEndPlus1            = nRowCount;
+            data.columnStart            = mStart;
+            data.columnEndPlus1         = mEndPlus1;
+
+            data.scale                  = 1;
+
+            data.rowNorms               = nSquaredNorms->v.base;
+            data.columnNorms            = mSquaredNorms->v.base;
+
+            data.rColumnCount           = rColumnCount;
+            data.rColumnStart           = mStart;
+            data.result                 = result;
+            data.m                      = n;
+            data.n                      = XMaths::TransposedView( m );
+
+            MultiplyBlock< T >( threadIndex, &data );
+            return;
+        }
+
+        ASSERT( !m.transposed && !n.transposed );
+
+        T* nPtr = n.base;
+
+        s32 paddedCount = XMaths::GetRowStride< T >( columnCount );
+
+        for( s32 i = 0; i < nRowCount; ++i, nPtr += n.rowStride, result += rColumnCount )
+        {
+            T* mPtr = &m.base[ mStart * m.rowStride ];
+
+            if( padded )
+            {
+                for( s32 j = mStart; j < mEndPlus1; ++j, mPtr += m.rowStride )
+                    result[ j - mStart ] = PaddedSquaredDistance( mPtr, nPtr, paddedCount );
+
+                continue;
+            }
+
+            for( s32 j = mStart; j < mEndPlus1; ++j, mPtr += m.rowStride )
+            {
+                T sum = 0;
+                for( s32 c = 0; c < columnCount; ++c )
+                {
+                    T diff  = mPtr[ c ] - nPtr[ c ];
+                    sum     += diff * diff;
+                }
+
+                result[ j - mStart ] = sum;
+            }
+        }
+    }
+
+    template< typename T >
+    void MultiplyAccumulateRows( s32 threadIndex, XMaths::MatrixView< T > m, XMaths::MatrixView< T > n, XMaths::Matrix< T >* result )
+    {
+        ASSERT( m.columnCount == n.rowCount );
+        ASSERT( result->rowCount == m.rowCount && result->columnCount == n.columnCount );
+        ASSERT( threadIndex < gemmPackBufferCount );
+
+        if( m.columnCount == 0 )
+            return;
+
+        MultiplyBlockData< T > data = {};
+        data.rowStart               = 0;
+        data.rowEndPlus1            = m.rowCount;
+        data.columnStart            = 0;
+        data.columnEndPlus1         = n.columnCount;
+
+        data.scale                  = 1;
+
+        data.accumulate             = true;
+
+        data.rColumnCount           = result->rowStride;
+        data.result                 = result->m.base;
+        data.m                      = m;
+        data.n                      = n;
+
+        MultiplyBlock< T >( threadIndex, &data );
+    }
+
+    void Exp( XMaths::Mf64* m, XMaths::Mf64* result )
+    {
+        ASSERT( m->rowCount     == result->rowCount );
+        ASSERT( m->columnCount  == result->columnCount );
+
+        for( s32 i = 0; i < m->rowCount; ++i )
+            XMaths::Exp( &m->m.base[ i * m->rowStride ], &result->m.base[ i * result->rowStride ], m->columnCount );
+    }
+
+    const s32 CHOLESKY_BLOCK_SIZE = 64;
+
+
+    struct CholeskyBlockData
+    {
+        s32 k;
+        s32 kb;
+
+        XMaths::Mf64* l;
+    };
+
+
+    //solves rows [ startIndex, endIndexPlus1 ) of the panel below the diagonal block at k against L11 transposed,
+    //the rows are counted from the end of the diagonal block
+    void CholeskyPanelBlock( s32 threadIndex, s32 startIndex, s32 endIndexPlus1, void* data )
+    {
+        CholeskyBlockData* choleskyBlockData = ( CholeskyBlockData* ) data;
+
+        s32 k               = choleskyBlockData->k;
+        s32 kb              = choleskyBlockData->kb;
+
+        s32 rowStride       = choleskyBlockData->l->rowStride;
+        f64* lArrayPtr      = choleskyBlockData->l->m.base;
+
+        for( s32 i = k + kb + startIndex; i < k + kb + endIndexPlus1; ++i )
+        {
+            f64* lPtr0 = &lArrayPtr[ i * rowStride ];
+
+            for( s32 j = k; j < k + kb; ++j )
+            {
+                f64* lPtr1 = &lArrayPtr[ j * rowStride ];
+
+                f64 sum = lPtr0[ j ];
+                for( s32 a = k; a < j; ++a )
+                    sum -= lPtr0[ a ] * lPtr1[ a ];
+
+                lPtr0[ j ] = sum / lPtr1[ j ];
+            }
+        }
+    }
+
+    //right looking blocked cholesky of the lower triangle of l in place,
+    //returns false if a pivot is not clearly positive
+    bool CholeskyFactor( XMaths::Mf64* l )
+    {
+        s32 size        = l->rowCount;
+        s32 rowStride   = l->rowStride;
+        f64* lArrayPtr  = l->m.base;
+
+        f64 maxDiagonal = 0;
+        for( s32 i = 0; i < size; ++i )
+            maxDiagonal = fmax( maxDiagonal, lArrayPtr[ i * rowStride + i ] );
+
+        f64 tolerance   = maxDiagonal * size * DBL_EPSILON;
+
+        bool result = true;
+
+        for( s32 k = 0; k < size && result; k += CHOLESKY_BLOCK_SIZE )
+        {
+            s32 kb = Utils::Min( CHOLESKY_BLOCK_SIZE, size - k );
+
+            for( s32 j = k; j < k + kb; ++j )
+            {
+                f64* lPtr0 = &lArrayPtr[ j * rowStride ];
+
+                f64 d = lPtr0[ j ];
+                for( s32 a = k; a < j; ++a )
+                    d -= lPtr0[ a ] * lPtr0[ a ];
+
+                if( !( d > tolerance ) )
+                {
+                    result = false;
+                    break;
+                }
+
+                d           = sqrt( d );
+                lPtr0[ j ]  = d;
+
+                for( s32 i = j + 1; i < k + kb; ++i )
+                {
+                    f64* lPtr1 = &lArrayPtr[ i * rowStride ];
+
+                    f64 sum = lPtr1[ j ];
+                    for( s32 a = k; a < j; ++a )
+                        sum -= lPtr1[ a ] * lPtr0[ a ];
+
+                    lPtr1[ j ] = sum / d;
+                }
+            }
+
+            s32 rowCount = size - ( k + kb );
+            if( !result || rowCount <= 0 )
+                continue;
+
+            CholeskyBlockData data = { k, kb, l };
+
+            s32 panelGrain  = Utils::Max( Platform::GetGrain( kb * kb / 2 ), F64_PER_CACHE_LINE );
+            Platform::ParallelFor( rowCount, panelGrain, CholeskyPanelBlock, &data );
+
+            //A22 -= L21 * L21^T on the gemm kernel, only the lower triangle is read afterwards
+            XMaths::Mf64View panel = XMaths::View( l, k + kb, rowCount, k, kb );
+            Multiply( panel, 0, -1.0, XMaths::TransposedView( panel ), &lArrayPtr[ ( k + kb ) * rowStride + k + kb ], rowStride, 0, 0, true, true );
+        }
+
+        return result;
+    }
+
+    //pivoted LDL^T of the lower triangle of l in place, used when l is only semi definite,
+    //pivots below tolerance are set to zero so those directions drop out of the solution
+    void LDLTFactor( XMaths::Mf64* l, XMaths::Vf64* d, s32* permutation )
+    {
+        s32 size        = l->rowCount;
+        s32 rowStride   = l->rowStride;
+        f64* lArrayPtr  = l->m.base;
+        f64* dPtr       = d->v.base;
+
+        f64 maxDiagonal = 0;
+        for( s32 i = 0; i < size; ++i )
+        {
+            permutation[ i ]    = i;
+            maxDiagonal         = fmax( maxDiagonal, fabs( lArrayPtr[ i * rowStride + i ] ) );
+        }
+
+        f64 tolerance = maxDiagonal * size * DBL_EPSILON;
+
+        for( s32 k = 0; k < size; ++k )
+        {
+            s32 p = k;
+            for( s32 i = k + 1; i < size; ++i )
+            {
+                if( fabs( lArrayPtr[ i * rowStride + i ] ) > fabs( lArrayPtr[ p * rowStride + p ] ) )
+                    p = i;
+            }
+
+            if( p != k )
+            {
+                //symmetric swap of row and column k and p, only touching the lower triangle
+                for( s32 a = 0; a < k; ++a )
+                {
+                    f64 swap                    = lArrayPtr[ k * rowStride + a ];
+                    lArrayPtr[ k * rowStride + a ]   = lArrayPtr[ p * rowStride + a ];
+                    lArrayPtr[ p * rowStride + a ]   = swap;
+                }
+
+                for( s32 a = k + 1; a < p; ++a )
+                {
+                    f64 swap                    = lArrayPtr[ a * rowStride + k ];
+                    lArrayPtr[ a * rowStride + k ]   = lArrayPtr[ p * rowStride + a ];
+                    lArrayPtr[ p * rowStride + a ]   = swap;
+                }
+
+                for( s32 a = p + 1; a < size; ++a )
+                {
+                    f64 swap                    = lArrayPtr[ a * rowStride + k ];
+                    lArrayPtr[ a * rowStride + k ]   = lArrayPtr[ a * rowStride + p ];
+                    lArrayPtr[ a * rowStride + p ]   = swap;
+                }
+
+                f64 swap                    = lArrayPtr[ k * rowStride + k ];
+                lArrayPtr[ k * rowStride + k ]   = lArrayPtr[ p * rowStride + p ];
+                lArrayPtr[ p * rowStride + p ]   = swap;
+
+                s32 index           = permutation[ k ];
+                permutation[ k ]    = permutation[ p ];
+                permutation[ p ]    = index;
+            }
+
+            f64 pivot = lArrayPtr[ k * rowStride + k ];
+
+            if( fabs( pivot ) <= tolerance )
+            {
+                //every remaining diagonal is smaller still
+                for( s32 i = k; i < size; ++i )
+                {
+                    dPtr[ i ] = 0;
+                    for( s32 j = k; j < i; ++j )
+                        lArrayPtr[ i * rowStride + j ] = 0;
+                }
+
+                break;
+            }
+
+            dPtr[ k ] = pivot;
+
+            f64 invPivot = 1.0 / pivot;
+
+            for( s32 i = k + 1; i < size; ++i )
+            {
+                f64* lPtr = &lArrayPtr[ i * rowStride ];
+
+                f64 element = lPtr[ k ];
+                for( s32 j = k + 1; j <= i; ++j )
+                    lPtr[ j ] -= element * lArrayPtr[ j * rowStride + k ] * invPivot;
+            }
+
+            for( s32 i = k + 1; i < size; ++i )
+                lArrayPtr[ i * rowStride + k ] *= invPivot;
+        }
+    }
+
+
+    struct TriangularSolveBlockData
+    {
+        bool unitDiagonal;
+
+        XMaths::Mf64* l;
+        XMaths::Vf64* d;
+        XMaths::Mf64* x;
+    };
+
+
+    //solves L * D * L^T * x = x in place for the columns of x in cache line blocks [ startIndex, endIndexPlus1 ),
+    //with D the identity when d is null; for cholesky L has a non unit diagonal
+    void TriangularSolveBlock( s32 threadIndex, s32 startIndex, s32 endIndexPlus1, void* data )
+    {
+        TriangularSolveBlockData* triangularSolveBlockData = ( TriangularSolveBlockData* ) data;
+
+        bool unitDiagonal   = triangularSolveBlockData->unitDiagonal;
+
+        s32 size            = triangularSolveBlockData->l->rowCount;
+        s32 lRowStride      = triangularSolveBlockData->l->rowStride;
+        f64* lArrayPtr      = triangularSolveBlockData->l->m.base;
+        f64* dPtr           = triangularSolveBlockData->d ? triangularSolveBlockData->d->v.base : 0;
+
+        s32 xColumnCount    = triangularSolveBlockData->x->columnCount;
+        s32 xRowStride      = triangularSolveBlockData->x->rowStride;
+        f64* xArrayPtr      = triangularSolveBlockData->x->m.base;
+
+        startIndex          *= F64_PER_CACHE_LINE;
+        endIndexPlus1       = Utils::Min( endIndexPlus1 * F64_PER_CACHE_LINE, xColumnCount );
+
+        for( s32 i = 0; i < size; ++i )
+        {
+            f64* lPtr   = &lArrayPtr[ i * lRowStride ];
+            f64* xPtr0  = &xArrayPtr[ i * xRowStride ];
+
+            for( s32 k = 0; k < i; ++k )
+            {
+                f64 element = lPtr[ k ];
+                f64* xPtr1  = &xArrayPtr[ k * xRowStride ];
+
+                for( s32 j = startIndex; j < endIndexPlus1; ++j )
+                    xPtr0[ j ] -= element * xPtr1[ j ];
+            }
+
+            if( !unitDiagonal )
+            {
+                f64 invDiagonal = 1.0 / lPtr[ i ];
+                for( s32 j = startIndex; j < endIndexPlus1; ++j )
+                    xPtr0[ j ] *= invDiagonal;
+            }
+        }
+
+        if( dPtr )
+        {
+            for( s32 i = 0; i < size; ++i )
+            {
+                f64 invD    = dPtr[ i ] != 0 ? 1.0 / dPtr[ i ] : 0;
+                f64* xPtr0  = &xArrayPtr[ i * xRowStride ];
+
+                for( s32 j = startIndex; j < endIndexPlus1; ++j )
+                    xPtr0[ j ] *= invD;
+            }
+        }
+
+        for( s32 i = size - 1; i >= 0; --i )
+        {
+            f64* xPtr0 = &xArrayPtr[ i * xRowStride ];
+
+            if( !unitDiagonal )
+            {
+                f64 invDiagonal = 1.0 / lArrayPtr[ i * lRowStride + i ];
+                for( s32 j = startIndex; j < endIndexPlus1; ++j )
+                    xPtr0[ j ] *= invDiagonal;
+            }
+
+            //x[ k ] -= L[ i ][ k ] * x[ i ] is L^T applied by columns, which keeps the L accesses row major
+            f64* lPtr = &lArrayPtr[ i * lRowStride ];
+            for( s32 k = 0; k < i; ++k )
+            {
+                f64 element = lPtr[ k ];
+                f64* xPtr1  = &xArrayPtr[ k * xRowStride ];
+
+                for( s32 j = startIndex; j < endIndexPlus1; ++j )
+                    xPtr1[ j ] -= element * xPtr0[ j ];
+            }
+        }
+    }
+
+    void TriangularSolve( XMaths::Mf64* l, XMaths::Vf64* d, bool unitDiagonal, XMaths::Mf64* x )
+    {
+        s32 size            = l->rowCount;
+        s32 blockCount      = ( x->columnCount + F64_PER_CACHE_LINE - 1 ) / F64_PER_CACHE_LINE;
+
+        TriangularSolveBlockData data = { unitDiagonal, l, d, x };
+
+        s32 grain = Platform::GetGrain( ( s64 ) 2 * size * size * F64_PER_CACHE_LINE );
+        Platform::ParallelFor( blockCount, grain, TriangularSolveBlock, &data );
+    }
+
+    const s32 LU_BLOCK_SIZE = 64;
+
+
+    struct LUBlockData
+    {
+        s32 k;
+        s32 kb;
+        //the panel column being eliminated
+        s32 j;
+
+        XMaths::Mf64* lu;
+        s32* pivots;
+    };
+
+
+    //eliminates column j from rows [ startIndex, endIndexPlus1 ) below it, counted from row j + 1,
+    //only updating the columns of the panel at k
+    void LUPanelBlock( s32 threadIndex, s32 startIndex, s32 endIndexPlus1, void* data )
+    {
+        LUBlockData* luBlockData = ( LUBlockData* ) data;
+
+        s32 kEndPlus1       = luBlockData->k + luBlockData->kb;
+        s32 j               = luBlockData->j;
+
+        s32 rowStride       = luBlockData->lu->rowStride;
+        f64* luArrayPtr     = luBlockData->lu->m.base;
+
+        f64* pivotPtr       = &luArrayPtr[ j * rowStride ];
+        f64 invPivot        = 1.0 / pivotPtr[ j ];
+
+        for( s32 i = j + 1 + startIndex; i < j + 1 + endIndexPlus1; ++i )
+        {
+            f64* luPtr      = &luArrayPtr[ i * rowStride ];
+
+            f64 element     = luPtr[ j ] * invPivot;
+            luPtr[ j ]      = element;
+
+            for( s32 a = j + 1; a < kEndPlus1; ++a )
+                luPtr[ a ] -= element * pivotPtr[ a ];
+        }
+    }
+
+    //applies the row swaps of the panel at k to the columns in cache line blocks [ startIndex, endIndexPlus1 ) outside
+    //it, which swapped its own as it went, and solves L11 * U12 = A12 for those right of it
+    void LUSwapSolveBlock( s32 threadIndex, s32 startIndex, s32 endIndexPlus1, void* data )
+    {
+        LUBlockData* luBlockData = ( LUBlockData* ) data;
+
+        s32 k               = luBlockData->k;
+        s32 kb              = luBlockData->kb;
+        s32* pivots         = luBlockData->pivots;
+
+        s32 size            = luBlockData->lu->rowCount;
+        s32 rowStride       = luBlockData->lu->rowStride;
+        f64* luArrayPtr     = luBlockData->lu->m.base;
+
+        startIndex          *= F64_PER_CACHE_LINE;
+        endIndexPlus1       = Utils::Min( endIndexPlus1 * F64_PER_CACHE_LINE, size );
+
+        for( s32 side = 0; side < 2; ++side )
+        {
+            s32 columnStart     = side == 0 ? startIndex : Utils::Max( startIndex, k + kb );
+            s32 columnEndPlus1  = side == 0 ? Utils::Min( endIndexPlus1, k ) : endIndexPlus1;
+
+            for( s32 i = k; i < k + kb; ++i )
+            {
+                if( pivots[ i ] == i )
+                    continue;
+
+                f64* luPtr0 = &luArrayPtr[ i * rowStride ];
+                f64* luPtr1 = &luArrayPtr[ pivots[ i ] * rowStride ];
+
+                for( s32 c = columnStart; c < columnEndPlus1; ++c )
+                {
+                    f64 swap    = luPtr0[ c ];
+                    luPtr0[ c ] = luPtr1[ c ];
+                    luPtr1[ c ] = swap;
+                }
+            }
+        }
+
+        s32 columnStart = Utils::Max( startIndex, k + kb );
+
+        for( s32 i = k + 1; i < k + kb; ++i )
+        {
+            f64* luPtr0 = &luArrayPtr[ i * rowStride ];
+
+            for( s32 a = k; a < i; ++a )
+            {
+                f64 element = luPtr0[ a ];
+                f64* luPtr1 = &luArrayPtr[ a * rowStride ];
+
+                for( s32 c = columnStart; c < endIndexPlus1; ++c )
+                    luPtr0[ c ] -= element * luPtr1[ c ];
+            }
+        }
+    }
+
+
+    struct LUSolveBlockData
+    {
+        XMaths::LUFactors* factors;
+        XMaths::Mf64* x;
+    };
+
+
+    //solves L * U * x = P * x in place for the columns of x in cache line blocks [ startIndex, endIndexPlus1 )
+    void LUSolveBlock( s32 threadIndex, s32 startIndex, s32 endIndexPlus1, void* data )
+    {
+        LUSolveBlockData* luSolveBlockData = ( LUSolveBlockData* ) data;
+
+        s32 size            = luSolveBlockData->factors->lu.rowCount;
+        s32 luRowStride     = luSolveBlockData->factors->lu.rowStride;
+        f64* luArrayPtr     = luSolveBlockData->factors->lu.m.base;
+        s32* pivots         = luSolveBlockData->factors->pivots.base;
+
+        s32 xColumnCount    = luSolveBlockData->x->columnCount;
+        s32 xRowStride      = luSolveBlockData->x->rowStride;
+        f64* xArrayPtr      = luSolveBlockData->x->m.base;
+
+        startIndex          *= F64_PER_CACHE_LINE;
+        endIndexPlus1       = Utils::Min( endIndexPlus1 * F64_PER_CACHE_LINE, xColumnCount );
+
+        for( s32 i = 0; i < size; ++i )
+        {
+            if( pivots[ i ] == i )
+                continue;
+
+            f64* xPtr0 = &xArrayPtr[ i * xRowStride ];
+            f64* xPtr1 = &xArrayPtr[ pivots[ i ] * xRowStride ];
+
+            for( s32 j = startIndex; j < endIndexPlus1; ++j )
+            {
+                f64 swap    = xPtr0[ j ];
+                xPtr0[ j ]  = xPtr1[ j ];
+                xPtr1[ j ]  = swap;
+            }
+        }
+
+        for( s32 i = 1; i < size; ++i )
+        {
+            f64* luPtr  = &luArrayPtr[ i * luRowStride ];
+            f64* xPtr0  = &xArrayPtr[ i * xRowStride ];
+
+            for( s32 k = 0; k < i; ++k )
+            {
+                f64 element = luPtr[ k ];
+                f64* xPtr1  = &xArrayPtr[ k * xRowStride ];
+
+                for( s32 j = startIndex; j < endIndexPlus1; ++j )
+                    xPtr0[ j ] -= element * xPtr1[ j ];
+            }
+        }
+
+        for( s32 i = size - 1; i >= 0; --i )
+        {
+            f64* luPtr  = &luArrayPtr[ i * luRowStride ];
+            f64* xPtr0  = &xArrayPtr[ i * xRowStride ];
+
+            for( s32 k = i + 1; k < size; ++k )
+            {
+                f64 element = luPtr[ k ];
+                f64* xPtr1  = &xArrayPtr[ k * xRowStride ];
+
+                for( s32 j = startIndex; j < endIndexPlus1; ++j )
+                    xPtr0[ j ] -= element * xPtr1[ j ];
+            }
+
+            f64 invDiagonal = 1.0 / luPtr[ i ];
+            for( s32 j = startIndex; j < endIndexPlus1; ++j )
+                xPtr0[ j ] *= invDiagonal;
+        }
+    }
+
+    //x = m^-1 * x, or m^-T * x when transposed, for a single vector on the calling thread, for the condition estimate
+    void LUSolveVector( XMaths::LUFactors* factors, f64* x, bool transposed )
+    {
+        s32 size        = factors->lu.rowCount;
+        s32 rowStride   = factors->lu.rowStride;
+        f64* luArrayPtr = factors->lu.m.base;
+        s32* pivots     = factors->pivots.base;
+
+        if( !transposed )
+        {
+            for( s32 i = 0; i < size; ++i )
+            {
+                f64 swap            = x[ i ];
+                x[ i ]              = x[ pivots[ i ] ];
+                x[ pivots[ i ] ]    = swap;
+            }
+
+            for( s32 i = 1; i < size; ++i )
+            {
+                f64* luPtr  = &luArrayPtr[ i * rowStride ];
+
+                f64 sum     = x[ i ];
+                for( s32 k = 0; k < i; ++k )
+                    sum -= luPtr[ k ] * x[ k ];
+
+                x[ i ] = sum;
+            }
+
+            for( s32 i = size - 1; i >= 0; --i )
+            {
+                f64* luPtr  = &luArrayPtr[ i * rowStride ];
+
+                f64 sum     = x[ i ];
+                for( s32 k = i + 1; k < size; ++k )
+                    sum -= luPtr[ k ] * x[ k ];
+
+                x[ i ] = sum / luPtr[ i ];
+            }
+        }
+        else
+        {
+            //m^T = U^T * L^T * P, U^T and L^T are taken a row of U and L at a time so the rows are read in order
+            for( s32 i = 0; i < size; ++i )
+            {
+                f64* luPtr  = &luArrayPtr[ i * rowStride ];
+
+                x[ i ]      /= luPtr[ i ];
+                for( s32 k = i + 1; k < size; ++k )
+                    x[ k ] -= luPtr[ k ] * x[ i ];
+            }
+
+            for( s32 i = size - 1; i > 0; --i )
+            {
+                f64* luPtr  = &luArrayPtr[ i * rowStride ];
+
+                for( s32 k = 0; k < i; ++k )
+                    x[ k ] -= luPtr[ k ] * x[ i ];
+            }
+
+            for( s32 i = size - 1; i >= 0; --i )
+            {
+                f64 swap            = x[ i ];
+                x[ i ]              = x[ pivots[ i ] ];
+                x[ pivots[ i ] ]    = swap;
+            }
+        }
+    }
+
+    //algorithm comes from Rutishauser, H. Numer. Math. (1966) 9: 1. https://doi.org/10.1007/BF02165223
+    void GetEigenVectorsAndValuesJacobi( XMaths::Mf64* m, XMaths::Mf64* eigenVectors, XMaths::Vf64* eigenValues )
+    {
+        ASSERT( m->rowCount == m->columnCount );
+
+        s32 rowCount            = m->rowCount;
+        s32 rowStride           = m->rowStride;
+
+        f64* mPtr               = m->m.base;
+
+        *eigenValues            = XMaths::CreateVf64( rowCount );
+        f64* valuePtr           = eigenValues->v.base;
+        *eigenVectors           = XMaths::UnitMf64( rowCount, rowCount );
+        f64* vectorPtr          = eigenVectors->m.base;
+        s32 eigenRowStride      = eigenVectors->rowStride;
+
+        for( s32 i = 0; i < rowCount; ++i )
+            valuePtr[ i ] = mPtr[ i * rowStride + i ];
+
+        f64 resultEpsilon = 0.0;
+
+        s32 maxIterations = 50;
+        for( s32 i = 0; i < maxIterations; ++i )
+        {
+            f64 sum = 0.0;
+
+            for( s32 j = 0; j < rowCount - 1; ++j )
+            {
+                for( s32 k = j + 1; k < rowCount; ++k )
+                    sum += fabs( mPtr[ j * rowStride + k ] );
+            }
+
+            if( sum <= resultEpsilon )
+                return;
+
+            f64 rotationThreshold = 0.0;
+
+            s32 smallValueCutoffIteration = 4;
+            if( i < smallValueCutoffIteration )
+                rotationThreshold = ( 0.2 * sum ) / ( rowCount * rowCount );
+
+            for( s32 j = 0; j < rowCount - 1; ++j )
+            {
+                for( s32 k = j + 1; k < rowCount; ++k )
+                {
+                    f64 fabsElementJK = fabs( mPtr[ j * rowStride + k ] );
+                    f64 g = 100.0 * fabsElementJK;
+
+                    f64 fabsEigenValueJ = fabs( valuePtr[ j ] );
+                    f64 fabsEigenValueK = fabs( valuePtr[ k ] );
+
+                    if( i > smallValueCutoffIteration
+                        && fabsEigenValueJ + g == fabsEigenValueJ
+                        && fabsEigenValueK + g == fabsEigenValueK )
+                    {
+                        mPtr[ j * rowStride + k ] = 0.0;
+                    }
+                    else if( fabsElementJK > rotationThreshold )
+                    {
+                        f64 h = valuePtr[ k ] - valuePtr[ j ];
+
+                        f64 t = 0;
+
+                        f64 fabsH = fabs( h );
+                        if( fabsH + g == fabsH )
+                        {
+                            t = mPtr[ j * rowStride + k ] / h;
+                        }
+                        else
+                        {
+                            f64 theta = 0.5 * h / mPtr[ j * rowStride + k ];
+                            t = 1.0 / ( fabs( theta ) + sqrt( 1 + theta * theta ) );
+
+                            if( theta < 0.0 )
+                                t = -t;
+                        }
+
+                        f64 c   = 1 / sqrt( 1 + t * t );
+                        f64 s   = t * c;
+                        f64 tau = s / ( 1 + c );
+
+                        h = t * mPtr[ j * rowStride + k ];
+
+                        valuePtr[ j ] -= h;
+                        valuePtr[ k ] += h;
+
+                        mPtr[ j * rowStride + k ] = 0.0;
+
+                        for( s32 x = 0; x < j; ++x )
+                        {
+                            g = mPtr[ x * rowStride + j ];
+                            h = mPtr[ x * rowStride + k ];
+
+                            mPtr[ x * rowStride + j ] = g - s * ( h + g * tau );
+                            mPtr[ x * rowStride + k ] = h + s * ( g - h * tau );
+                        }
+
+                        for( s32 x = j + 1; x < k; ++x )
+                        {
+                            g = mPtr[ j * rowStride + x ];
+                            h = mPtr[ x * rowStride + k ];
+
+                            mPtr[ j * rowStride + x ] = g - s * ( h + g * tau );
+                            mPtr[ x * rowStride + k ] = h + s * ( g - h * tau );
+                        }
+
+                        for( s32 x = k + 1; x < rowCount; ++x )
+                        {
+                            g = mPtr[ j * rowStride + x ];
+                            h = mPtr[ k * rowStride + x ];
+
+                            mPtr[ j * rowStride + x ] = g - s * ( h + g * tau );
+                            mPtr[ k * rowStride + x ] = h + s * ( g - h * tau );
+                        }
+
+                        for( s32 x = 0; x < rowCount; ++x )
+                        {
+                            g = vectorPtr[ x * eigenRowStride + j ];
+                            h = vectorPtr[ x * eigenRowStride + k ];
+
+                            vectorPtr[ x * eigenRowStride + j ] = g - s * ( h + g * tau );
+                            vectorPtr[ x * eigenRowStride + k ] = h + s * ( g - h * tau );
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void SortEigenVectorsAndValues( XMaths::Mf64* eigenVectors, XMaths::Vf64* eigenValues )
+    {
+        s32 count       = eigenValues->count;
+        s32 rowStride   = eigenVectors->rowStride;
+
+        f64* vectorPtr  = eigenVectors->m.base;
+        f64* valuePtr   = eigenValues->v.base;
+
+        for( s32 i = 0; i < count - 1; ++i )
+        {
+            s32 k = i;
+            f64 p = valuePtr[ i ];
+
+            for( s32 j = i + 1; j < count; ++j )
+            {
+                if( valuePtr[ j ] >= p )
+                {
+                    k = j;
+                    p = valuePtr[ j ];
+                }
+            }
+
+            if( k != i )
+            {
+                valuePtr[ k ] = valuePtr[ i ];
+                valuePtr[ i ] = p;
+
+                for( s32 j = 0; j < count; ++j )
+                {
+                    s32 row = j * rowStride;
+                    p = vectorPtr[ row + i ];
+                    vectorPtr[ row + i ] = vectorPtr[ row + k ];
+                    vectorPtr[ row + k ] = p;
+                }
+            }
+        }
+    }
+
+
+    //extra vectors the subspace iteration carries past the ones asked for, so the ones asked for converge at the
+    //rate of their gap to the first eigenvalue left outside the block rather than to the next one in
+    const s32 PCA_SUBSPACE_OVERSAMPLING     = 8;
+    const s32 PCA_SUBSPACE_MAX_ITERATIONS   = 200;
+    //largest residual |C q - theta q| a converged vector can have, against the largest eigenvalue
+    const f64 PCA_SUBSPACE_TOLERANCE        = 1e-9;
+
+
+    //fills row i of q with values from a fixed xorshift sequence, so the same data always starts from the same vectors
+    void RandomRow( XMaths::Mf64* q, s32 i, u64* state )
+    {
+        f64* qPtr = &q->m.base[ i * q->rowStride ];
+
+        for( s32 j = 0; j < q->columnCount; ++j )
+        {
+            *state      ^= *state << 13;
+            *state      ^= *state >> 7;
+            *state      ^= *state << 17;
+
+            qPtr[ j ]   = ( f64 ) ( *state >> 11 ) / ( f64 ) ( 1ull << 53 ) - 0.5;
+        }
+    }
+
+    //makes the rows of q orthonormal in place, modified gram schmidt run twice so they are orthogonal to working
+    //precision; a row that all but vanishes against the ones before it, because the data has lower rank than the
+    //block, is replaced by a random row and tried again
+    void OrthonormaliseRows( XMaths::Mf64* q, u64* state )
+    {
+        s32 rowCount    = q->rowCount;
+        s32 columnCount = q->columnCount;
+        s32 rowStride   = q->rowStride;
+        f64* qArrayPtr  = q->m.base;
+
+        for( s32 i = 0; i < rowCount; ++i )
+        {
+            f64* qPtr0 = &qArrayPtr[ i * rowStride ];
+
+            for( s32 attempt = 0; ; ++attempt )
+            {
+                f64 norm0 = 0;
+                for( s32 j = 0; j < columnCount; ++j )
+                    norm0 += qPtr0[ j ] * qPtr0[ j ];
+
+                for( s32 pass = 0; pass < 2; ++pass )
+                {
+                    for( s32 k = 0; k < i; ++k )
+                    {
+                        f64* qPtr1 = &qArrayPtr[ k * rowStride ];
+
+                        f64 dot = 0;
+                        for( s32 j = 0; j < columnCount; ++j )
+                            dot += qPtr0[ j ] * qPtr1[ j ];
+
+                        for( s32 j = 0; j < columnCount; ++j )
+                            qPtr0[ j ] -= dot * qPtr1[ j ];
+                    }
+                }
+
+                f64 norm = 0;
+                for( s32 j = 0; j < columnCount; ++j )
+                    norm += qPtr0[ j ] * qPtr0[ j ];
+
+                if( norm > norm0 * 1e-20 && norm > 0 )
+                {
+                    f64 invNorm = 1.0 / sqrt( norm );
+                    for( s32 j = 0; j < columnCount; ++j )
+                        qPtr0[ j ] *= invNorm;
+
+                    break;
+                }
+
+                ASSERT( attempt < 8 );
+                RandomRow( q, i, state );
+            }
+        }
+    }
+
+    //the leading count eigenpairs of the covariance of m's rows by block power iteration with a rayleigh ritz step,
+    //without forming the covariance: the block is kept as the rows of q and each iteration takes ( X - mean )^T *
+    //( X - mean ) * q^T through two gemms over m, centring the first product and correcting the second for the
+    //small column sums that centring leaves, so data far from the origin keeps its precision
+    void GetLeadingEigenVectorsSubspace( XMaths::Mf64* m, s32 count, XMaths::Mf64* eigenVectors, XMaths::Vf64* eigenValues )
+    {
+        s32 rowCount        = m->rowCount;
+        s32 columnCount     = m->columnCount;
+        s32 blockCount      = Utils::Min( count + PCA_SUBSPACE_OVERSAMPLING, columnCount );
+
+        XMaths::Vf64 mean   = XMaths::GetMeanColumns( m );
+        f64* meanPtr        = mean.v.base;
+
+        XMaths::Mf64 q          = XMaths::CreateMf64( blockCount, columnCount );
+        XMaths::Mf64 y          = {};
+        XMaths::Mf64 z          = {};
+        XMaths::Mf64 h          = XMaths::CreateMf64( blockCount, blockCount );
+        XMaths::Mf64 rotated    = {};
+        XMaths::Mf64 swap       = {};
+        XMaths::Mf64 ritzVectors;
+        XMaths::Vf64 ritzValues;
+
+        u64 state = 0x9e3779b97f4a7c15ull;
+        for( s32 i = 0; i < blockCount; ++i )
+            RandomRow( &q, i, &state );
+
+        OrthonormaliseRows( &q, &state );
+
+        for( s32 iteration = 0; ; ++iteration )
+        {
+            //y = ( X - mean ) * q^T, centred a column at a time
+            XMaths::Evaluate( &y, XMaths::Lazy( m ) * XMaths::Transposed( &q ) );
+
+            f64* yArrayPtr = y.m.base;
+
+            for( s32 j = 0; j < blockCount; ++j )
+            {
+                f64* qPtr   = &q.m.base[ j * q.rowStride ];
+
+                f64 offset  = 0;
+                for( s32 a = 0; a < columnCount; ++a )
+                    offset += meanPtr[ a ] * qPtr[ a ];
+
+                for( s32 i = 0; i < rowCount; ++i )
+                    yArrayPtr[ i * y.rowStride + j ] -= offset;
+            }
+
+            //z = y^T * ( X - mean ) = y^T * X - colsums( y ) * mean^T
+            XMaths::Evaluate( &z, XMaths::Transposed( &y ) * *m );
+
+            XMaths::Vf64 ySums = XMaths::GetMeanColumns( &y );
+            for( s32 j = 0; j < blockCount; ++j )
+            {
+                f64 ySum    = ySums.v.base[ j ] * rowCount;
+                f64* zPtr   = &z.m.base[ j * z.rowStride ];
+
+                for( s32 a = 0; a < columnCount; ++a )
+                    zPtr[ a ] -= ySum * meanPtr[ a ];
+            }
+
+            //h = q * z^T, the covariance within the block, symmetrised against rounding
+            for( s32 i = 0; i < blockCount; ++i )
+            {
+                for( s32 j = 0; j <= i; ++j )
+                {
+                    f64* qPtr0  = &q.m.base[ i * q.rowStride ];
+                    f64* qPtr1  = &q.m.base[ j * q.rowStride ];
+                    f64* zPtr0  = &z.m.base[ i * z.rowStride ];
+                    f64* zPtr1  = &z.m.base[ j * z.rowStride ];
+
+                    f64 sum = 0;
+                    for( s32 a = 0; a < columnCount; ++a )
+                        sum += qPtr0[ a ] * zPtr1[ a ] + qPtr1[ a ] * zPtr0[ a ];
+
+                    h.m.base[ i * h.rowStride + j ] = 0.5 * sum;
+                    h.m.base[ j * h.rowStride + i ] = 0.5 * sum;
+                }
+            }
+
+            GetEigenVectorsAndValuesJacobi( &h, &ritzVectors, &ritzValues );
+            SortEigenVectorsAndValues( &ritzVectors, &ritzValues );
+
+            //rotate the block and its product onto the ritz vectors, swapping storage so none is allocated again
+            XMaths::Evaluate( &rotated, XMaths::Transposed( &ritzVectors ) * q );
+            swap    = q;
+            q       = rotated;
+            rotated = swap;
+
+            XMaths::Evaluate( &rotated, XMaths::Transposed( &ritzVectors ) * z );
+            swap    = z;
+            z       = rotated;
+            rotated = swap;
+
+            f64 maxResidual = 0;
+            for( s32 j = 0; j < count; ++j )
+            {
+                f64* qPtr   = &q.m.base[ j * q.rowStride ];
+                f64* zPtr   = &z.m.base[ j * z.rowStride ];
+                f64 theta   = ritzValues.v.base[ j ];
+
+                f64 residual = 0;
+                for( s32 a = 0; a < columnCount; ++a )
+                {
+                    f64 difference  = zPtr[ a ] - theta * qPtr[ a ];
+                    residual        += difference * difference;
+                }
+
+                maxResidual = fmax( maxResidual, sqrt( residual ) );
+            }
+
+            if( maxResidual <= PCA_SUBSPACE_TOLERANCE * fabs( ritzValues.v.base[ 0 ] ) || iteration + 1 >= PCA_SUBSPACE_MAX_ITERATIONS )
+                break;
+
+            swap    = q;
+            q       = z;
+            z       = swap;
+            OrthonormaliseRows( &q, &state );
+        }
+
+        f64 invRowCountMinus1   = 1.0 / ( ( f64 ) rowCount - 1.0 );
+
+        *eigenValues            = XMaths::CreateVf64( count );
+        *eigenVectors           = XMaths::CreateMf64( columnCount, count );
+
+        for( s32 j = 0; j < count; ++j )
+        {
+            eigenValues->v.base[ j ] = ritzValues.v.base[ j ] * invRowCountMinus1;
+
+            for( s32 a = 0; a < columnCount; ++a )
+                eigenVectors->m.base[ a * eigenVectors->rowStride + j ] = q.m.base[ j * q.rowStride + a ];
+        }
+    }
+
+
+    f64 GetCoordinate( XMaths::KDTree* tree, s32 point, s32 dimension )
+    {
+        return tree->points->m.base[ point * tree->points->rowStride + dimension ];
+    }
+
+    //reorders indices[ start, start + count ) so the one at middle has its final sorted place along dimension,
+    //with none after it smaller and none before it larger
+    void SelectKDTreeMedian( XMaths::KDTree* tree, s32 start, s32 count, s32 middle, s32 dimension )
+    {
+        s32* indices    = tree->indices.base;
+
+        s32 low         = start;
+        s32 high        = start + count - 1;
+
+        while( low < high )
+        {
+            f64 pivot   = GetCoordinate( tree, indices[ ( low + high ) / 2 ], dimension );
+
+            s32 i       = low;
+            s32 j       = high;
+
+            while( i <= j )
+            {
+                while( GetCoordinate( tree, indices[ i ], dimension ) < pivot )
+                    ++i;
+
+                while( GetCoordinate( tree, indices[ j ], dimension ) > pivot )
+                    --j;
+
+                if( i <= j )
+                {
+                    s32 swap        = indices[ i ];
+                    indices[ i ]    = indices[ j ];
+                    indices[ j ]    = swap;
+
+                    ++i;
+                    --j;
+                }
+            }
+
+            if( middle <= j )
+                high = j;
+            else if( middle >= i )
+                low = i;
+            else
+                break;
+        }
+    }
+
+    s32 BuildKDTreeNode( XMaths::KDTree* tree, s32 start, s32 count )
+    {
+        ASSERT( tree->nodeCount < tree->nodes.count );
+
+        s32 index                   = tree->nodeCount++;
+        XMaths::KDTreeNode* node    = &tree->nodes.base[ index ];
+
+        node->splitDimension        = -1;
+        node->splitValue            = 0;
+        node->start                 = start;
+        node->count                 = count;
+        node->right                 = -1;
+
+        if( count <= XMaths::KD_TREE_LEAF_SIZE )
+            return index;
+
+        s32* indices    = tree->indices.base;
+
+        s32 dimension   = -1;
+        f64 spread      = 0;
+
+        for( s32 j = 0; j < tree->points->columnCount; ++j )
+        {
+            f64 min = GetCoordinate( tree, indices[ start ], j );
+            f64 max = min;
+
+            for( s32 i = start + 1; i < start + count; ++i )
+            {
+                f64 value = GetCoordinate( tree, indices[ i ], j );
+                min = fmin( min, value );
+                max = fmax( max, value );
+            }
+
+            if( max - min > spread )
+            {
+                spread      = max - min;
+                dimension   = j;
+            }
+        }
+
+        //every point is the same one, nothing to split
+        if( dimension < 0 )
+            return index;
+
+        s32 middle = start + count / 2;
+        SelectKDTreeMedian( tree, start, count, middle, dimension );
+
+        node->splitDimension    = dimension;
+        node->splitValue        = GetCoordinate( tree, indices[ middle ], dimension );
+
+        BuildKDTreeNode( tree, start, middle - start );
+        s32 right = BuildKDTreeNode( tree, middle, start + count - middle );
+
+        tree->nodes.base[ index ].right = right;
+
+        return index;
+    }
+
+    //padded queries have the points' row stride and compare whole vectors across the padding
+    f64 GetKDTreeDistance( XMaths::KDTree* tree, s32 point, f64* query, bool padded )
+    {
+        s32 rowStride   = tree->points->rowStride;
+        f64* pPtr       = &tree->points->m.base[ point * rowStride ];
+
+        if( padded )
+            return PaddedSquaredDistance( pPtr, query, rowStride );
+
+        f64 distance = 0;
+        for( s32 j = 0; j < tree->points->columnCount; ++j )
+            distance += ( pPtr[ j ] - query[ j ] ) * ( pPtr[ j ] - query[ j ] );
+
+        return distance;
+    }
+
+    //the left of a split holds the points at or below its value and the right those at or above, so the far side of
+    //a split can only hold a nearer point than the best so far when the query is closer to the split than that
+    void SearchKDTree( XMaths::KDTree* tree, s32 nodeIndex, f64* query, s32 skip, bool padded, s32* best, f64* bestDistance )
+    {
+        XMaths::KDTreeNode* node = &tree->nodes.base[ nodeIndex ];
+
+        if( node->splitDimension < 0 )
+        {
+            s32* indices = tree->indices.base;
+
+            for( s32 i = node->start; i < node->start + node->count; ++i )
+            {
+                s32 point = indices[ i ];
+                if( point == skip )
+                    continue;
+
+                f64 distance = GetKDTreeDistance( tree, point, query, padded );
+
+                if( distance < *bestDistance || ( distance == *bestDistance && point < *best ) )
+                {
+                    *bestDistance   = distance;
+                    *best           = point;
+                }
+            }
+
+            return;
+        }
+
+        f64 difference  = query[ node->splitDimension ] - node->splitValue;
+        s32 nearChild   = difference < 0 ? nodeIndex + 1 : node->right;
+        s32 farChild    = difference < 0 ? node->right : nodeIndex + 1;
+
+        SearchKDTree( tree, nearChild, query, skip, padded, best, bestDistance );
+
+        if( difference * difference <= *bestDistance )
+            SearchKDTree( tree, farChild, query, skip, padded, best, bestDistance );
+    }
+
+    //the same walk with a fixed radius, returns the count after this node's points are added
+    s32 SearchKDTreeWithin( XMaths::KDTree* tree, s32 nodeIndex, f64* query, f64 squaredRadius, bool padded,
+                            s32* indices, f64* squaredDistances, s32 count )
+    {
+        XMaths::KDTreeNode* node = &tree->nodes.base[ nodeIndex ];
+
+        if( node->splitDimension < 0 )
+        {
+            for( s32 i = node->start; i < node->start + node->count; ++i )
+            {
+                s32 point       = tree->indices.base[ i ];
+                f64 distance    = GetKDTreeDistance( tree, point, query, padded );
+
+                if( distance <= squaredRadius )
+                {
+                    indices[ count ]            = point;
+                    squaredDistances[ count ]   = distance;
+                    ++count;
+                }
+            }
+
+            return count;
+        }
+
+        f64 difference  = query[ node->splitDimension ] - node->splitValue;
+        s32 nearChild   = difference < 0 ? nodeIndex + 1 : node->right;
+        s32 farChild    = difference < 0 ? node->right : nodeIndex + 1;
+
+        count = SearchKDTreeWithin( tree, nearChild, query, squaredRadius, padded, indices, squaredDistances, count );
+
+        if( difference * difference <= squaredRadius )
+            count = SearchKDTreeWithin( tree, farChild, query, squaredRadius, padded, indices, squaredDistances, count );
+
+        return count;
+    }
+
+
+    struct NearestData
+    {
+        XMaths::KDTree* tree;
+        f64* squaredDistances;
+        s32* nearest;
+    };
+
+    void NearestRows( s32 threadIndex, s32 startIndex, s32 endIndexPlus1, void* data )
+    {
+        NearestData* nearestData    = ( NearestData* ) data;
+        XMaths::KDTree* tree        = nearestData->tree;
+
+        for( s32 i = startIndex; i < endIndexPlus1; ++i )
+        {
+            s32 best            = -1;
+            f64 bestDistance    = HUGE_VAL;
+
+            if( tree->nodeCount > 0 )
+                SearchKDTree( tree, 0, &tree->points->m.base[ i * tree->points->rowStride ], i, true, &best, &bestDistance );
+
+            nearestData->squaredDistances[ i ] = bestDistance;
+            if( nearestData->nearest )
+                nearestData->nearest[ i ] = best;
+        }
+    }
+
+
+    //roughly what one exp costs against a multiply add, for picking how many make a job
+    const s32 EXP_WORK = 16;
+
+
+    //what the simple row and element loops below work on
+    struct LoopData
+    {
+        XMaths::Mf64View m;
+        f64* result;
+    };
+
+    struct ColumnSumData
+    {
+        XMaths::Mf64View m;
+        //blockRowCount rows to a block, one row of sums per block
+        f64* blockSums;
+        s32 blockRowCount;
+    };
+
+    struct EvaluateData
+    {
+        XMaths::MatrixExpression e;
+        XMaths::Mf64* result;
+    };
+
+
+    void SumRowsBlock( s32 threadIndex, s32 startIndex, s32 endIndexPlus1, void* data )
+    {
+        LoopData* loopData  = ( LoopData* ) data;
+        XMaths::Mf64View m  = loopData->m;
+        s32 columnCount     = m.columnCount;
+        s32 rowStride       = m.transposed ? 1 : m.rowStride;
+        s32 columnStride    = m.transposed ? m.rowStride : 1;
+        f64* rArrayPtr      = loopData->result;
+
+        for( s32 i = startIndex; i < endIndexPlus1; ++i )
+        {
+            f64* mPtr = &m.base[ i * rowStride ];
+
+            f64 sum = 0;
+            for( s32 j = 0; j < columnCount; ++j )
+                sum += mPtr[ j * columnStride ];
+
+            rArrayPtr[ i ] = sum;
+        }
+    }
+
+    //m is a whole matrix and result has its row stride, only the columns are taken so the padding stays zero
+    void ExpBlock( s32 threadIndex, s32 startIndex, s32 endIndexPlus1, void* data )
+    {
+        LoopData* loopData  = ( LoopData* ) data;
+        XMaths::Mf64View m  = loopData->m;
+
+        for( s32 i = startIndex; i < endIndexPlus1; ++i )
+            XMaths::Exp( &m.base[ i * m.rowStride ], &loopData->result[ i * m.rowStride ], m.columnCount );
+    }
+
+    void ColumnSumBlock( s32 threadIndex, s32 startIndex, s32 endIndexPlus1, void* data )
+    {
+        ColumnSumData* columnSumData    = ( ColumnSumData* ) data;
+        XMaths::Mf64View m              = columnSumData->m;
+        s32 rowCount                    = m.rowCount;
+        s32 columnCount                 = m.columnCount;
+        s32 rowStride                   = m.transposed ? 1 : m.rowStride;
+        s32 columnStride                = m.transposed ? m.rowStride : 1;
+
+        for( s32 b = startIndex; b < endIndexPlus1; ++b )
+        {
+            f64* sPtr           = &columnSumData->blockSums[ b * columnCount ];
+            s32 rowStart        = b * columnSumData->blockRowCount;
+            s32 rowEndPlus1     = Utils::Min( rowStart + columnSumData->blockRowCount, rowCount );
+
+            for( s32 j = 0; j < columnCount; ++j )
+                sPtr[ j ] = 0;
+
+            for( s32 i = rowStart; i < rowEndPlus1; ++i )
+            {
+                f64* mPtr = &m.base[ i * rowStride ];
+                for( s32 j = 0; j < columnCount; ++j )
+                    sPtr[ j ] += mPtr[ j * columnStride ];
+            }
+        }
+    }
+
+    //zeroes the padding of rows [ startIndex, endIndexPlus1 ) of a new matrix, through ParallelFor so on several
+    //NUMA nodes the rows first touch the nodes that run them as Convert's do
+    template< typename T >
+    void ZeroPaddingRows( s32 threadIndex, s32 startIndex, s32 endIndexPlus1, void* data )
+    {
+        XMaths::Matrix< T >* m  = ( XMaths::Matrix< T >* ) data;
+        s32 columnCount         = m->columnCount;
+        s32 rowStride           = m->rowStride;
+
+        for( s32 i = startIndex; i < endIndexPlus1; ++i )
+        {
+            T* mPtr = &m->m.base[ i * rowStride ];
+            for( s32 j = columnCount; j < rowStride; ++j )
+                mPtr[ j ] = 0;
+        }
+    }
+
+    template< typename T >
+    void ZeroPadding( XMaths::Matrix< T >* m )
+    {
+        if( m->rowStride > m->columnCount )
+            Platform::ParallelFor( m->rowCount, Platform::GetGrain( m->rowStride ), ZeroPaddingRows< T >, m );
+    }
+
+    template< typename T >
+    XMaths::Matrix< T > CreateMatrix( s32 rows, s32 columns, Arena* arena )
+    {
+        s32 rowStride               = XMaths::GetRowStride< T >( columns );
+        s32 count                   = rows * rowStride;
+
+        XMaths::Matrix< T > result  = { rows, columns, rowStride, arena ? Array< T >( count, arena ) : Array< T >( count, CACHE_LINE_SIZE ) };
+        ZeroPadding( &result );
+
+        return result;
+    }
+
+    template< typename T >
+    struct ConvertData
+    {
+        XMaths::Mf64* m;
+        XMaths::Vf64* offset;
+        XMaths::Matrix< T >* result;
+    };
+
+    template< typename T >
+    void ConvertRows( s32 threadIndex, s32 startIndex, s32 endIndexPlus1, void* data )
+    {
+        ConvertData< T >* convertData   = ( ConvertData< T >* ) data;
+        s32 columnCount                 = convertData->m->columnCount;
+        s32 mRowStride                  = convertData->m->rowStride;
+        s32 rRowStride                  = convertData->result->rowStride;
+        f64* oPtr                       = convertData->offset ? convertData->offset->v.base : 0;
+
+        f64* mPtr                       = &convertData->m->m.base[ startIndex * mRowStride ];
+        T* rPtr                         = &convertData->result->m.base[ startIndex * rRowStride ];
+
+        for( s32 i = startIndex; i < endIndexPlus1; ++i, mPtr += mRowStride, rPtr += rRowStride )
+        {
+            for( s32 j = 0; j < columnCount; ++j )
+                rPtr[ j ] = ( T ) ( oPtr ? mPtr[ j ] - oPtr[ j ] : mPtr[ j ] );
+        }
+    }
+
+    struct CentreData
+    {
+        XMaths::Mf64View m;
+        f64* mean;
+        XMaths::Mf64* result;
+    };
+
+    void CentreRows( s32 threadIndex, s32 startIndex, s32 endIndexPlus1, void* data )
+    {
+        CentreData* centreData  = ( CentreData* ) data;
+        s32 columnCount         = centreData->m.columnCount;
+        s32 mRowStride          = centreData->m.rowStride;
+        s32 rRowStride          = centreData->result->rowStride;
+        f64* meanPtr            = centreData->mean;
+
+        f64* mPtr               = &centreData->m.base[ startIndex * mRowStride ];
+        f64* rPtr               = &centreData->result->m.base[ startIndex * rRowStride ];
+
+        for( s32 i = startIndex; i < endIndexPlus1; ++i, mPtr += mRowStride, rPtr += rRowStride )
+        {
+            for( s32 j = 0; j < columnCount; ++j )
+                rPtr[ j ] = mPtr[ j ] - meanPtr[ j ];
+        }
+    }
+
+    //GetCovariance( Mf64* ) adds rows to its accumulator in blocks of about this many bytes, a whole number of
+    //GEMM_KC panels, so the centred copy of a block stays small whatever the size of the data
+    const s32 COVARIANCE_BLOCK_BYTES = 4 * 1024 * 1024;
+
+
+    template< typename T >
+    void ConvertMatrix( XMaths::Mf64* m, XMaths::Vf64* offset, XMaths::Matrix< T >* result )
+    {
+        ASSERT( result->rowCount == m->rowCount );
+        ASSERT( result->columnCount == m->columnCount );
+        ASSERT( !offset || offset->count == m->columnCount );
+
+        ConvertData< T > data = { m, offset, result };
+        Platform::ParallelFor( m->rowCount, Platform::GetGrain( m->columnCount ), ConvertRows< T >, &data );
+    }
+
+    void EvaluateRows( s32 threadIndex, s32 startIndex, s32 endIndexPlus1, void* data )
+    {
+        EvaluateData* evaluateData  = ( EvaluateData* ) data;
+        XMaths::MatrixExpression e  = evaluateData->e;
+
+        s32 columnCount             = evaluateData->result->columnCount;
+        s32 rRowStride              = evaluateData->result->rowStride;
+
+        f64* rPtr                   = &evaluateData->result->m.base[ startIndex * rRowStride ];
+        f64* mArrayPtr              = e.m.base;
+        f64* dPtr                   = e.diagonal ? e.diagonal->v.base : 0;
+        f64 scale                   = e.scale;
+
+        s32 rowStride               = e.m.transposed ? 1 : e.m.rowStride;
+        s32 columnStride            = e.m.transposed ? e.m.rowStride : 1;
+
+        for( s32 i = startIndex; i < endIndexPlus1; ++i, rPtr += rRowStride )
+        {
+            f64* mPtr = &mArrayPtr[ i * rowStride ];
+
+            for( s32 j = 0; j < columnCount; ++j )
+                rPtr[ j ] = mPtr[ j * columnStride ] * ( dPtr ? dPtr[ j ] * scale : scale );
+        }
+    }
+}
+
+
+namespace XMaths
+{
+    s32 ArrayProduct( s32* array, s32 count )
+    {
+        ASSERT( count > 0 );
+
+        s32 result = array[ 0 ];
+        for( s32 i = 1; i < count; ++i )
+            result *= array[ i ];
+        return result;
+    }
+
+
+    void Exp( f64* values, f64* result, s32 count, f64 scale )
+    {
+        s32 i = 0;
+
+#ifdef XMATHS_AVX2
+        __m256d scale4 = _mm256_set1_pd( scale );
+
+        //two independent vectors per iteration hide most of the polynomial latency
+        for( ; i + 8 <= count; i += 8 )
+        {
+            __m256d a = Exp4( _mm256_mul_pd( _mm256_loadu_pd( &values[ i ] ), scale4 ) );
+            __m256d b = Exp4( _mm256_mul_pd( _mm256_loadu_pd( &values[ i + 4 ] ), scale4 ) );
+            _mm256_storeu_pd( &result[ i ], a );
+            _mm256_storeu_pd( &result[ i + 4 ], b );
+        }
+
+        for( ; i + 4 <= count; i += 4 )
+            _mm256_storeu_pd( &result[ i ], Exp4( _mm256_mul_pd( _mm256_loadu_pd( &values[ i ] ), scale4 ) ) );
+#endif
+
+        for( ; i < count; ++i )
+            result[ i ] = ExpScalar( values[ i ] * scale );
+    }
+
+    void Log( f64* values, f64* result, s32 count )
+    {
+        s32 i = 0;
+
+#ifdef XMATHS_AVX2
+        for( ; i + 4 <= count; i += 4 )
+        {
+            __m256d x = _mm256_loadu_pd( &values[ i ] );
+
+            if( LogNeedsScalar( x ) )
+            {
+                for( s32 j = i; j < i + 4; ++j )
+                    result[ j ] = LogScalar( values[ j ] );
+            }
+            else
+            {
+                _mm256_storeu_pd( &result[ i ], LogNormal4( x ) );
+            }
+        }
+#endif
+
+        for( ; i < count; ++i )
+            result[ i ] = LogScalar( values[ i ] );
+    }
+
+    f64 SumLog( f64* values, s32 count )
+    {
+        f64 result = 0;
+        s32 i = 0;
+
+#ifdef XMATHS_AVX2
+        __m256d sum = _mm256_setzero_pd();
+
+        for( ; i + 4 <= count; i += 4 )
+        {
+            __m256d x = _mm256_loadu_pd( &values[ i ] );
+
+            if( LogNeedsScalar( x ) )
+            {
+                for( s32 j = i; j < i + 4; ++j )
+                    result += LogScalar( values[ j ] );
+            }
+            else
+            {
+                sum = _mm256_add_pd( sum, LogNormal4( x ) );
+            }
+        }
+
+        ALIGN_32 f64 lanes[ 4 ];
+        _mm256_store_pd( lanes, sum );
+        result += ( lanes[ 0 ] + lanes[ 1 ] ) + ( lanes[ 2 ] + lanes[ 3 ] );
+#endif
+
+        for( ; i < count; ++i )
+            result += LogScalar( values[ i ] );
+
+        return result;
+    }
+
+    void Exp( f32* values, f32* result, s32 count, f32 scale )
+    {
+        s32 i = 0;
+
+#ifdef XMATHS_AVX2
+        __m256 scale8 = _mm256_set1_ps( scale );
+
+        for( ; i + 16 <= count; i += 16 )
+        {
+            __m256 a = Exp8( _mm256_mul_ps( _mm256_loadu_ps( &values[ i ] ), scale8 ) );
+            __m256 b = Exp8( _mm256_mul_ps( _mm256_loadu_ps( &values[ i + 8 ] ), scale8 ) );
+            _mm256_storeu_ps( &result[ i ], a );
+            _mm256_storeu_ps( &result[ i + 8 ], b );
+        }
+
+        for( ; i + 8 <= count; i += 8 )
+            _mm256_storeu_ps( &result[ i ], Exp8( _mm256_mul_ps( _mm256_loadu_ps( &values[ i ] ), scale8 ) ) );
+#endif
+
+        for( ; i < count; ++i )
+            result[ i ] = ExpScalar( values[ i ] * scale );
+    }
+
+    f64 SumLog( f32* values, s32 count )
+    {
+        f64 result = 0;
+        s32 i = 0;
+
+#ifdef XMATHS_AVX2
+        __m256d sum = _mm256_setzero_pd();
+
+        for( ; i + 4 <= count; i += 4 )
+        {
+            __m256d x = _mm256_cvtps_pd( _mm_loadu_ps( &values[ i ] ) );
+
+            if( LogNeedsScalar( x ) )
+            {
+                for( s32 j = i; j < i + 4; ++j )
+                    result += LogScalar( ( f64 ) values[ j ] );
+            }
+            else
+            {
+                sum = _mm256_add_pd( sum, LogNormal4( x ) );
+            }
+        }
+
+        ALIGN_32 f64 lanes[ 4 ];
+        _mm256_store_pd( lanes, sum );
+        result += ( lanes[ 0 ] + lanes[ 1 ] ) + ( lanes[ 2 ] + lanes[ 3 ] );
+#endif
+
+        for( ; i < count; ++i )
+            result += LogScalar( ( f64 ) values[ i ] );
+
+        return result;
+    }
+
+
+    Vf64 CreateVf64( s32 count )
+    {
+        Vf64 result = { count, Array< f64 >( count, CACHE_LINE_SIZE ) };
+        return result;
+    }
+
+    Vf64 CreateVf64( s32 count, Arena* arena )
+    {
+        Vf64 result = { count, Array< f64 >( count, arena ) };
+        return result;
+    }
+
+    Vf32 CreateVf32( s32 count )
+    {
+        Vf32 result = { count, Array< f32 >( count, CACHE_LINE_SIZE ) };
+        return result;
+    }
+
+    void SqrtEquals( Vf64* v )
+    {
+        s32 count = v->count;
+        f64* vPtr = v->v.base;
+
+        for( s32 i = 0; i < count; ++i )
+            vPtr[ i ] = sqrt( vPtr[ i ] );
+    }
+
+    f64 GetMean( Vf64* v )
+    {
+        f64 result = 0;
+
+        s32 count = v->count;
+        f64* vPtr = v->v.base;
+
+        for( s32 i = 0; i < count; ++i )
+            result += vPtr[ i ];
+
+        result /= ( f64 ) count;
+
+        return result;
+    }
+
+
+    template<>
+    void Mf64::operator += ( const Mf64 &n )
+    {
+        ASSERT( rowCount == n.rowCount );
+        ASSERT( columnCount == n.columnCount );
+
+        for( s32 i = 0; i < rowCount; ++i )
+        {
+            f64* mPtr = &m.base[ i * rowStride ];
+            f64* nPtr = &n.m.base[ i * n.rowStride ];
+
+            for( s32 j = 0; j < columnCount; ++j )
+                mPtr[ j ] += nPtr[ j ];
+        }
+    }
+
+    template<>
+    Mf64 Mf64::operator * ( const Mf64 &n )
+    {
+        ASSERT( columnCount == n.rowCount );
+
+        s32 nColumnCount    = n.columnCount;
+
+        if( columnCount == 0 )
+            return ZeroMf64( rowCount, nColumnCount );
+
+        Mf64 result         = CreateMf64( rowCount, nColumnCount );
+
+        Multiply( View( this ), 0, 1, View( ( Mf64* ) &n ), result.m.base, result.rowStride, 0, 0 );
+
+        return result;
+    }
+
+    template<>
+    Mf64 Mf64::operator * ( f64 s )
+    {
+        Mf64 result = CreateMf64( rowCount, columnCount );
+
+        for( s32 i = 0; i < rowCount; ++i )
+        {
+            f64* rPtr = &result.m.base[ i * result.rowStride ];
+            f64* mPtr = &m.base[ i * rowStride ];
+
+            for( s32 j = 0; j < columnCount; ++j )
+                rPtr[ j ] = mPtr[ j ] * s;
+        }
+
+        return result;
+    }
+
+    template<>
+    void Mf64::operator *= ( f64 s )
+    {
+        for( s32 i = 0; i < rowCount; ++i )
+        {
+            f64* mPtr = &m.base[ i * rowStride ];
+            for( s32 j = 0; j < columnCount; ++j )
+                mPtr[ j ] *= s;
+        }
+    }
+
+    Mf64 CreateMf64( s32 rows, s32 columns )
+    {
+        return CreateMatrix< f64 >( rows, columns, 0 );
+    }
+
+    Mf64 CreateMf64( s32 rows, s32 columns, Arena* arena )
+    {
+        return CreateMatrix< f64 >( rows, columns, arena );
+    }
+
+    Mf32 CreateMf32( s32 rows, s32 columns )
+    {
+        return CreateMatrix< f32 >( rows, columns, 0 );
+    }
+
+    void Convert( Mf64* m, Vf64* offset, Mf32* result )
+    {
+        ConvertMatrix( m, offset, result );
+    }
+
+    void Convert( Mf64* m, Vf64* offset, Mf64* result )
+    {
+        ConvertMatrix( m, offset, result );
+    }
+
+    void Resize( Mf64* m, s32 rows, s32 columns )
+    {
+        s32 rowStride   = GetRowStride< f64 >( columns );
+        f64* base       = m->m.base;
+
+        ResizeArray( &m->m, rows * rowStride );
+
+        if( m->m.base == base && m->rowCount == rows && m->columnCount == columns && m->rowStride == rowStride )
+            return;
+
+        m->rowCount     = rows;
+        m->columnCount  = columns;
+        m->rowStride    = rowStride;
+
+        ZeroPadding( m );
+    }
+
+    void Resize( Vf64* v, s32 count )
+    {
+        ResizeArray( &v->v, count );
+        v->count = count;
+    }
+
+    void Resize( Vf32* v, s32 count )
+    {
+        ResizeArray( &v->v, count );
+        v->count = count;
+    }
+
+    Mf64 ZeroMf64( s32 rows, s32 columns )
+    {
+        Mf64 result = CreateMf64( rows, columns );
+        memset( result.m.base, 0, sizeof( f64 ) * rows * result.rowStride );
+
+        return result;
+    }
+
+    Mf64 UnitMf64( s32 rows, s32 columns )
+    {
+        Mf64 result = ZeroMf64( rows, columns );
+        f64* rPtr   = result.m.base;
+
+        for( s32 i = 0; i < rows && i < columns; ++i )
+            rPtr[ i * result.rowStride + i ] = 1;
+
+        return result;
+    }
+
+    void ReplaceRow( Mf64* m, s32 row, Vf64* v )
+    {
+        ASSERT( row >= 0 );
+        ASSERT( row < m->rowCount );
+        ASSERT( m->columnCount == v->count );
+
+        s32 columnCount = m->columnCount;
+        row *= m->rowStride;
+
+        f64* mPtr = m->m.base;
+        f64* vPtr = v->v.base;
+
+        for( s32 i = 0; i < columnCount; ++i )
+            mPtr[ row + i ] = vPtr[ i ];
+    }
+
+    //the row stride stays as it is, so the column only has to be zeroed into the padding
+    void DeleteLastColumn( Mf64* m )
+    {
+        ASSERT( m->columnCount > 0 );
+
+        f64* mPtr       = m->m.base;
+
+        s32 rowCount    = m->rowCount;
+        s32 columnCount = --m->columnCount;
+
+        for( s32 i = 0; i < rowCount; ++i )
+            mPtr[ i * m->rowStride + columnCount ] = 0;
+    }
+
+    MatrixExpression Lazy( Mf64* m )
+    {
+        return Lazy( View( m ) );
+    }
+
+    MatrixExpression Lazy( Mf64View m )
+    {
+        MatrixExpression result = { m, 0, 1.0 };
+        return result;
+    }
+
+    MatrixExpression Transposed( Mf64* m )
+    {
+        return Lazy( TransposedView( View( m ) ) );
+    }
+
+    MatrixExpression Transposed( Mf64View m )
+    {
+        return Lazy( TransposedView( m ) );
+    }
+
+    DiagonalExpression Diagonal( Vf64* d )
+    {
+        DiagonalExpression result = { d };
+        return result;
+    }
+
+    MatrixExpression operator * ( MatrixExpression e, DiagonalExpression d )
+    {
+        ASSERT( !e.diagonal );
+
+        e.diagonal = d.d;
+        return e;
+    }
+
+    MatrixExpression operator * ( Mf64 &m, DiagonalExpression d )
+    {
+        MatrixExpression result = { View( &m ), d.d, 1.0 };
+        return result;
+    }
+
+    MatrixExpression operator * ( f64 s, MatrixExpression e )
+    {
+        e.scale *= s;
+        return e;
+    }
+
+    ProductExpression operator * ( MatrixExpression a, MatrixExpression b )
+    {
+        ProductExpression result = { a, b };
+        return result;
+    }
+
+    ProductExpression operator * ( MatrixExpression a, Mf64 &b )
+    {
+        MatrixExpression n          = Lazy( &b );
+        ProductExpression result    = { a, n };
+        return result;
+    }
+
+    ProductExpression operator * ( Mf64 &a, MatrixExpression b )
+    {
+        MatrixExpression m          = Lazy( &a );
+        ProductExpression result    = { m, b };
+        return result;
+    }
+
+    ProductExpression operator * ( f64 s, ProductExpression p )
+    {
+        p.a.scale *= s;
+        return p;
+    }
+
+    void Evaluate( Mf64* result, MatrixExpression e )
+    {
+        s32 rowCount        = e.m.rowCount;
+        s32 columnCount     = e.m.columnCount;
+
+        ASSERT( result->m.base != e.m.base );
+        ASSERT( !e.diagonal || e.diagonal->count == columnCount );
+
+        Resize( result, rowCount, columnCount );
+
+        EvaluateData data = { e, result };
+        Platform::ParallelFor( rowCount, Platform::GetGrain( columnCount ), EvaluateRows, &data );
+    }
+
+    void Evaluate( Mf64* result, ProductExpression p )
+    {
+        MatrixExpression a  = p.a;
+        MatrixExpression b  = p.b;
+
+        s32 rowCount        = a.m.rowCount;
+        s32 innerCount      = a.m.columnCount;
+        s32 columnCount     = b.m.columnCount;
+
+        ASSERT( innerCount == b.m.rowCount );
+        ASSERT( !a.diagonal || a.diagonal->count == innerCount );
+        ASSERT( !b.diagonal );
+        ASSERT( result->m.base != a.m.base && result->m.base != b.m.base );
+
+        Resize( result, rowCount, columnCount );
+
+        if( innerCount == 0 )
+        {
+            memset( result->m.base, 0, sizeof( f64 ) * rowCount * result->rowStride );
+            return;
+        }
+
+        Multiply( a.m, a.diagonal ? a.diagonal->v.base : 0, a.scale * b.scale, b.m, result->m.base, result->rowStride, 0, 0 );
+    }
+
+    void WeightedGram( Mf64* m, Vf64* weights, Mf64* result )
+    {
+        s32 size        = m->columnCount;
+        s32 innerCount  = m->rowCount;
+
+        ASSERT( !weights || weights->count == innerCount );
+        ASSERT( result->m.base != m->m.base );
+
+        Resize( result, size, size );
+
+        if( innerCount == 0 )
+        {
+            memset( result->m.base, 0, sizeof( f64 ) * size * result->rowStride );
+            return;
+        }
+
+        Multiply( TransposedView( View( m ) ), weights ? weights->v.base : 0, 1, View( m ), result->m.base, result->rowStride, 0, 0, true );
+    }
+
+    Mf64 MultiplyWithDiagonal( Mf64* m, Vf64* d )
+    {
+        Mf64 result = {};
+        Evaluate( &result, *m * Diagonal( d ) );
+        return result;
+    }
+
+    Mf64 MultiplyWithTranspose( Mf64* m, Mf64* t )
+    {
+        ASSERT( m->columnCount == t->columnCount );
+
+        s32 mRowCount       = m->rowCount;
+        s32 tRowCount       = t->rowCount;
+        s32 tColumnCount    = t->columnCount;
+        Mf64 result         = CreateMf64( mRowCount, tRowCount );
+
+        f64* rArrayPtr      = result.m.base;
+        f64* mArrayPtr      = m->m.base;
+        f64* tArrayPtr      = t->m.base;
+
+        for( s32 i = 0; i < mRowCount; ++i )
+        {
+            f64* rPtr = &rArrayPtr[ i * result.rowStride ];
+            f64* mPtr = &mArrayPtr[ i * m->rowStride ];
+
+            for( s32 j = 0; j < tRowCount; ++j )
+            {
+                f64* tPtr = &tArrayPtr[ j * t->rowStride ];
+
+                f64 sum = 0;
+                for( s32 k = 0; k < tColumnCount; ++k )
+                    sum += mPtr[ k ] * tPtr[ k ];
+
+                rPtr[ j ] = sum;
+            }
+        }
+
+        return result;
+    }
+
+    Vf64 SumRows( Mf64* m )
+    {
+        return SumRows( View( m ) );
+    }
+
+    Vf64 SumRows( Mf64View m )
+    {
+        Vf64 result         = CreateVf64( m.rowCount );
+        LoopData data       = { m, result.v.base };
+
+        Platform::ParallelFor( m.rowCount, Platform::GetGrain( m.columnCount ), SumRowsBlock, &data );
+
+        return result;
+    }
+
+    Mf64 GetTranspose( Mf64* m )
+    {
+        Mf64 result = {};
+        Evaluate( &result, Transposed( m ) );
+        return result;
+    }
+
+    void ExpEquals( Mf64* m )
+    {
+        LoopData data = { View( m ), m->m.base };
+        Platform::ParallelFor( m->rowCount, Platform::GetGrain( EXP_WORK * m->columnCount ), ExpBlock, &data );
+    }
+
+    Vf64 GetMeanRows( Mf64* m )
+    {
+        s32 rowCount        = m->rowCount;
+        s32 columnCount     = m->columnCount;
+        f64 invColumnCount  = 1.0 / ( f64 ) columnCount;
+
+        Vf64 result         = CreateVf64( rowCount );
+        f64* rArrayPtr      = result.v.base;
+        f64* mArrayPtr      = m->m.base;
+
+        for( s32 i = 0; i < rowCount; ++i )
+        {
+            f64* mPtr = &mArrayPtr[ i * m->rowStride ];
+
+            f64 sum = 0;
+            for( s32 j = 0; j < columnCount; ++j )
+                sum += mPtr[ j ];
+
+            sum *= invColumnCount;
+
+            rArrayPtr[ i ] = sum;
+        }
+
+        return result;
+    }
+
+    //each block of rows is summed on its own and the block sums are added up in order afterwards,
+    //the blocks only depend on the matrix size so the result does not change with the processor count
+    Vf64 GetMeanColumns( Mf64* m )
+    {
+        return GetMeanColumns( View( m ) );
+    }
+
+    Vf64 GetMeanColumns( Mf64View m )
+    {
+        s32 rowCount        = m.rowCount;
+        s32 columnCount     = m.columnCount;
+        f64 invRowCount     = 1.0 / ( f64 ) rowCount;
+        Vf64 result         = CreateVf64( columnCount );
+
+        s32 blockRowCount   = Platform::GetGrain( columnCount );
+        s32 blockCount      = ( rowCount + blockRowCount - 1 ) / blockRowCount;
+
+        WORKSPACE_MEMORY();
+        ColumnSumData data  = { m, workspace.Push< f64 >( blockCount * columnCount ), blockRowCount };
+
+        Platform::ParallelFor( blockCount, 1, ColumnSumBlock, &data );
+
+        f64* rArrayPtr      = result.v.base;
+        for( s32 j = 0; j < columnCount; ++j )
+            rArrayPtr[ j ] = 0;
+
+        for( s32 b = 0; b < blockCount; ++b )
+        {
+            f64* sPtr = &data.blockSums[ b * columnCount ];
+            for( s32 j = 0; j < columnCount; ++j )
+                rArrayPtr[ j ] += sPtr[ j ];
+        }
+
+        for( s32 j = 0; j < columnCount; ++j )
+            rArrayPtr[ j ] *= invRowCount;
+
+        return result;
+    }
+
+    CovarianceAccumulator CreateCovarianceAccumulator( s32 columns )
+    {
+        CovarianceAccumulator result = { 0, CreateVf64( columns ), ZeroMf64( columns, columns ) };
+
+        for( s32 j = 0; j < columns; ++j )
+            result.mean.v.base[ j ] = 0;
+
+        return result;
+    }
+
+    void AddRows( CovarianceAccumulator* accumulator, Mf64View rows )
+    {
+        ASSERT( !rows.transposed );
+        ASSERT( rows.columnCount == accumulator->mean.count );
+
+        s32 rowCount        = rows.rowCount;
+        s32 columnCount     = rows.columnCount;
+
+        if( rowCount == 0 )
+            return;
+
+        WORKSPACE_MEMORY();
+
+        Vf64 blockMean      = GetMeanColumns( rows );
+        Mf64 centred        = CreateMf64( rowCount, columnCount, &workspace );
+        Mf64 blockScatter   = CreateMf64( columnCount, columnCount, &workspace );
+        f64* delta          = workspace.Push< f64 >( columnCount );
+
+        CentreData data     = { rows, blockMean.v.base, &centred };
+        Platform::ParallelFor( rowCount, Platform::GetGrain( columnCount ), CentreRows, &data );
+
+        Multiply( TransposedView( View( &centred ) ), 0, 1, View( &centred ), blockScatter.m.base, blockScatter.rowStride, 0, 0, true );
+
+        //chan's update: the scatters add up, plus what the gap between the two means adds about the merged mean
+        f64 count0          = ( f64 ) accumulator->count;
+        f64 count1          = ( f64 ) rowCount;
+        f64 count           = count0 + count1;
+        f64 weight          = count0 * count1 / count;
+
+        f64* meanPtr        = accumulator->mean.v.base;
+        for( s32 j = 0; j < columnCount; ++j )
+            delta[ j ] = blockMean.v.base[ j ] - meanPtr[ j ];
+
+        s32 sRowStride      = accumulator->scatter.rowStride;
+        s32 bRowStride      = blockScatter.rowStride;
+
+        for( s32 i = 0; i < columnCount; ++i )
+        {
+            f64* sPtr = &accumulator->scatter.m.base[ i * sRowStride ];
+            f64* bPtr = &blockScatter.m.base[ i * bRowStride ];
+
+            for( s32 j = 0; j <= i; ++j )
+                sPtr[ j ] += bPtr[ j ] + weight * delta[ i ] * delta[ j ];
+        }
+
+        for( s32 j = 0; j < columnCount; ++j )
+            meanPtr[ j ] += delta[ j ] * ( count1 / count );
+
+        accumulator->count += rowCount;
+    }
+
+    Mf64 GetCovariance( CovarianceAccumulator* accumulator )
+    {
+        s32 size                = accumulator->scatter.rowCount;
+        s32 sRowStride          = accumulator->scatter.rowStride;
+        f64* sArrayPtr          = accumulator->scatter.m.base;
+
+        Mf64 result             = CreateMf64( size, size );
+        s32 rRowStride          = result.rowStride;
+        f64* rArrayPtr          = result.m.base;
+
+        f64 invCountMinus1      = 1.0 / ( ( f64 ) accumulator->count - 1.0 );
+
+        for( s32 i = 0; i < size; ++i )
+        {
+            for( s32 j = 0; j <= i; ++j )
+            {
+                f64 value                       = sArrayPtr[ i * sRowStride + j ] * invCountMinus1;
+                rArrayPtr[ i * rRowStride + j ] = value;
+                rArrayPtr[ j * rRowStride + i ] = value;
+            }
+        }
+
+        return result;
+    }
+
+    Mf64 GetCovariance( Mf64* m )
+    {
+        s32 blockRowCount = COVARIANCE_BLOCK_BYTES / ( sizeof( f64 ) * m->rowStride );
+        blockRowCount     = Utils::Max( blockRowCount / GEMM_KC, 1 ) * GEMM_KC;
+
+        CovarianceAccumulator accumulator = CreateCovarianceAccumulator( m->columnCount );
+
+        for( s32 i = 0; i < m->rowCount; i += blockRowCount )
+            AddRows( &accumulator, View( m, i, Utils::Min( blockRowCount, m->rowCount - i ), 0, m->columnCount ) );
+
+        return GetCovariance( &accumulator );
+    }
+
+    Vf64 GetMinColumns( Mf64* m )
+    {
+        s32 rowCount    = m->rowCount;
+        s32 columnCount = m->columnCount;
+        Vf64 result     = CreateVf64( columnCount );
+
+        f64* rArrayPtr  = result.v.base;
+        f64* mArrayPtr  = m->m.base;
+        f64* mPtr       = mArrayPtr;
+
+        for( s32 i = 0; i < columnCount; ++i )
+            rArrayPtr[ i ] = mPtr[ i ];
+
+        for( s32 i = 1; i < rowCount; ++i )
+        {
+            mPtr = &mArrayPtr[ i * m->rowStride ];
+            for( s32 j = 0; j < columnCount; ++j )
+                rArrayPtr[ j ] = fmin( rArrayPtr[ j ], mPtr[ j ] );
+        }
+
+        return result;
+    }
+
+    bool LUFactor( Mf64* m, LUFactors* factors )
+    {
+        ASSERT( m->rowCount == m->columnCount );
+        ASSERT( factors->lu.m.base != m->m.base );
+
+        s32 size        = m->rowCount;
+
+        Resize( &factors->lu, size, size );
+        ResizeArray( &factors->pivots, size );
+        factors->singular = false;
+
+        Mf64* lu        = &factors->lu;
+        s32 rowStride   = lu->rowStride;
+        f64* luArrayPtr = lu->m.base;
+        s32* pivots     = factors->pivots.base;
+
+        for( s32 i = 0; i < size; ++i )
+            memcpy( &luArrayPtr[ i * rowStride ], &m->m.base[ i * m->rowStride ], sizeof( f64 ) * size );
+
+        {
+            WORKSPACE_MEMORY();
+
+            f64* columnSums = workspace.Push< f64 >( size );
+            for( s32 j = 0; j < size; ++j )
+                columnSums[ j ] = 0;
+
+            for( s32 i = 0; i < size; ++i )
+            {
+                f64* luPtr = &luArrayPtr[ i * rowStride ];
+                for( s32 j = 0; j < size; ++j )
+                    columnSums[ j ] += fabs( luPtr[ j ] );
+            }
+
+            factors->norm = 0;
+            for( s32 j = 0; j < size; ++j )
+                factors->norm = fmax( factors->norm, columnSums[ j ] );
+        }
+
+        s32 blockCount = ( size + F64_PER_CACHE_LINE - 1 ) / F64_PER_CACHE_LINE;
+
+        for( s32 k = 0; k < size; k += LU_BLOCK_SIZE )
+        {
+            s32 kb = Utils::Min( LU_BLOCK_SIZE, size - k );
+
+            LUBlockData data = { k, kb, 0, lu, pivots };
+
+            //the panel, columns [ k, k + kb ) from row k down, one column at a time
+            for( s32 j = k; j < k + kb; ++j )
+            {
+                s32 p   = j;
+                f64 max = fabs( luArrayPtr[ j * rowStride + j ] );
+                for( s32 i = j + 1; i < size; ++i )
+                {
+                    f64 element = fabs( luArrayPtr[ i * rowStride + j ] );
+                    if( element > max )
+                    {
+                        max = element;
+                        p   = i;
+                    }
+                }
+
+                pivots[ j ] = p;
+
+                //the column is already zero below the diagonal, so there is nothing to eliminate
+                if( max == 0 )
+                {
+                    factors->singular = true;
+                    continue;
+                }
+
+                if( p != j )
+                {
+                    f64* luPtr0 = &luArrayPtr[ j * rowStride ];
+                    f64* luPtr1 = &luArrayPtr[ p * rowStride ];
+
+                    for( s32 a = k; a < k + kb; ++a )
+                    {
+                        f64 swap    = luPtr0[ a ];
+                        luPtr0[ a ] = luPtr1[ a ];
+                        luPtr1[ a ] = swap;
+                    }
+                }
+
+                s32 rowCount = size - ( j + 1 );
+                if( rowCount > 0 )
+                {
+                    data.j = j;
+                    Platform::ParallelFor( rowCount, Platform::GetGrain( 2 * ( k + kb - j ) ), LUPanelBlock, &data );
+                }
+            }
+
+            s32 trailingCount   = size - ( k + kb );
+            s32 swapSolveGrain  = Platform::GetGrain( ( s64 ) kb * ( kb + 1 ) * F64_PER_CACHE_LINE );
+            Platform::ParallelFor( blockCount, swapSolveGrain, LUSwapSolveBlock, &data );
+
+            //A22 -= L21 * U12 on the gemm kernel
+            if( trailingCount > 0 )
+            {
+                Multiply( View( lu, k + kb, trailingCount, k, kb ), 0, -1.0, View( lu, k, kb, k + kb, trailingCount ),
+                          &luArrayPtr[ ( k + kb ) * rowStride + k + kb ], rowStride, 0, 0, false, true );
+            }
+        }
+
+        return !factors->singular;
+    }
+
+    void SolveLU( LUFactors* factors, Mf64* b, Mf64* result )
+    {
+        ASSERT( !factors->singular );
+        ASSERT( factors->lu.rowCount == b->rowCount );
+        ASSERT( result->m.base != factors->lu.m.base );
+
+        s32 size        = factors->lu.rowCount;
+        s32 columnCount = b->columnCount;
+
+        if( result->m.base != b->m.base )
+        {
+            Resize( result, size, columnCount );
+            for( s32 i = 0; i < size; ++i )
+                memcpy( &result->m.base[ i * result->rowStride ], &b->m.base[ i * b->rowStride ], sizeof( f64 ) * columnCount );
+        }
 
-        f64* mPtr = m.base;
-        f64* nPtr = n.m.base;
+        LUSolveBlockData data = { factors, result };
 
-        s32 count = rowCount * columnCount;
-        for( s32 i = 0; i < count; ++i )
-            mPtr[ i ] += nPtr[ i ];
+        s32 blockCount  = ( columnCount + F64_PER_CACHE_LINE - 1 ) / F64_PER_CACHE_LINE;
+        s32 grain       = Platform::GetGrain( ( s64 ) 2 * size * size * F64_PER_CACHE_LINE );
+        Platform::ParallelFor( blockCount, grain, LUSolveBlock, &data );
     }
 
-    Mf64 Mf64::operator * ( const Mf64 &n )
+    f64 GetConditionEstimate( LUFactors* factors )
     {
-        ASSERT( columnCount == n.rowCount );
+        if( factors->singular )
+            return HUGE_VAL;
 
-        s32 nRowCount       = n.rowCount;
-        s32 nColumnCount    = n.columnCount;
-        Mf64 result         = ZeroMf64( rowCount, nColumnCount );
+        s32 size = factors->lu.rowCount;
+        if( size == 0 )
+            return 0;
+
+        WORKSPACE_MEMORY();
+
+        f64* x = workspace.Push< f64 >( size );
+        f64* z = workspace.Push< f64 >( size );
 
-        s32 iJumpCount      = Utils::Max( F64_PER_CACHE_LINE, ( rowCount - 1 ) / Platform::GetProcessorCount() + 1 );
-        s32 jJumpStartCount = F64_PER_CACHE_LINE * 128;
+        //hager's estimate of |m^-1|, refined as higham does for dlacon: climb from x to the unit vector that
+        //most increases |m^-1 x| until it stops growing, then also try a vector of alternating signs
+        for( s32 i = 0; i < size; ++i )
+            x[ i ] = 1.0 / size;
 
-        s32 dataIndex   = 0;
-        s32 dataCount   = ( rowCount - 1 ) / iJumpCount + 1;
-        dataCount       *= ( nColumnCount - 1 ) / jJumpStartCount + 1;
-        Mf64MultiplyBlockData* data = new Mf64MultiplyBlockData[ dataCount ];
+        f64 inverseNorm = 0;
+        s32 previous    = -1;
 
-        for( s32 i = 0; i < rowCount; i += iJumpCount )
+        for( s32 iteration = 0; iteration < 5; ++iteration )
         {
-            iJumpCount      = Utils::Min( iJumpCount, rowCount - i );
-            s32 jJumpCount  = jJumpStartCount;
+            LUSolveVector( factors, x, false );
 
-            s32 indexR      = i * nColumnCount;
-            s32 indexM      = i * columnCount;
+            f64 norm = 0;
+            for( s32 i = 0; i < size; ++i )
+                norm += fabs( x[ i ] );
 
-            for( s32 j = 0; j < nColumnCount; j += jJumpCount )
-            {
-                jJumpCount      = Utils::Min( jJumpCount, nColumnCount - j );
-                s32 kJumpCount  = F64_PER_CACHE_LINE * 8;
-                kJumpCount      = Utils::Min( kJumpCount, nRowCount );
+            if( iteration > 0 && norm <= inverseNorm )
+                break;
 
-                data[ dataIndex ] = {};
-                data[ dataIndex ].columnCount   = columnCount;
-                data[ dataIndex ].nRowCount     = nRowCount;
-                data[ dataIndex ].nColumnCount  = nColumnCount;
+            inverseNorm = norm;
 
-                data[ dataIndex ].iJumpCount    = iJumpCount;
-                data[ dataIndex ].jJumpCount    = jJumpCount;
-                data[ dataIndex ].kJumpCount    = kJumpCount;
+            for( s32 i = 0; i < size; ++i )
+                z[ i ] = x[ i ] >= 0 ? 1.0 : -1.0;
 
-                data[ dataIndex ].indexR        = indexR;
-                data[ dataIndex ].indexM        = indexM;
-                data[ dataIndex ].j             = j;
+            LUSolveVector( factors, z, true );
 
-                data[ dataIndex ].result        = &result;
-                data[ dataIndex ].m             = this;
-                data[ dataIndex ].n             = ( Mf64* ) &n;
-                Platform::AddWorkQueueEntry( Mf64MultiplyBlock, &data[ dataIndex ] );
-                ++dataIndex;
+            s32 j = 0;
+            for( s32 i = 1; i < size; ++i )
+            {
+                if( fabs( z[ i ] ) > fabs( z[ j ] ) )
+                    j = i;
             }
-        }
 
-        Platform::FinishWork();
+            if( j == previous )
+                break;
 
-        delete [] data;
+            previous = j;
 
-        return result;
-    }
+            for( s32 i = 0; i < size; ++i )
+                x[ i ] = 0;
 
-    Mf64 Mf64::operator * ( f64 s )
-    {
-        Mf64 result = CreateMf64( rowCount, columnCount );
-        f64* rPtr   = result.m.base;
-        f64* mPtr   = m.base;
+            x[ j ] = 1;
+        }
 
-        s32 count = rowCount * columnCount;
-        for( s32 i = 0; i < count; ++i )
-            rPtr[ i ] = mPtr[ i ] * s;
+        for( s32 i = 0; i < size; ++i )
+            x[ i ] = ( i % 2 ? -1.0 : 1.0 ) * ( 1.0 + ( size > 1 ? ( f64 ) i / ( size - 1 ) : 0 ) );
 
-        return result;
-    }
+        LUSolveVector( factors, x, false );
 
-    void Mf64::operator *= ( f64 s )
-    {
-        f64* mPtr = m.base;
+        f64 norm = 0;
+        for( s32 i = 0; i < size; ++i )
+            norm += fabs( x[ i ] );
 
-        s32 count = rowCount * columnCount;
-        for( s32 i = 0; i < count; ++i )
-            mPtr[ i ] *= s;
-    }
+        inverseNorm = fmax( inverseNorm, 2 * norm / ( 3 * size ) );
 
-    Mf64 CreateMf64( s32 rows, s32 columns )
-    {
-        Mf64 result = { rows, columns, Array< f64 >( rows * columns, CACHE_LINE_SIZE ) };
-        return result;
+        return factors->norm * inverseNorm;
     }
 
-    Mf64 ZeroMf64( s32 rows, s32 columns )
+    Mf64 Invert( Mf64* m )
     {
-        Mf64 result = CreateMf64( rows, columns );
-        f64* rPtr   = result.m.base;
+        LUFactors factors = {};
+        LUFactor( m, &factors );
+        ASSERT( !factors.singular );
 
-        s32 count = rows * columns;
-        for( s32 i = 0; i < count; ++i )
-            rPtr[ i ] = 0;
+        Mf64 result = UnitMf64( m->rowCount, m->rowCount );
+        SolveLU( &factors, &result, &result );
 
         return result;
     }
 
-    Mf64 UnitMf64( s32 rows, s32 columns )
+    Mf64 SolveSymmetric( Mf64* m, Mf64* b )
     {
-        Mf64 result = ZeroMf64( rows, columns );
-        f64* rPtr   = result.m.base;
-
-        for( s32 i = 0; i < rows && i < columns; ++i )
-            rPtr[ i * rows + i ] = 1;
-
+        Mf64 result = {};
+        SolveSymmetric( m, b, &result );
         return result;
     }
 
-    void ReplaceRow( Mf64* m, s32 row, Vf64* v )
+    void SolveSymmetric( Mf64* m, Mf64* b, Mf64* result )
     {
-        ASSERT( row >= 0 );
-        ASSERT( row < m->rowCount );
-        ASSERT( m->columnCount == v->count );
-
-        s32 columnCount = m->columnCount;
-        row *= columnCount;
-
-        f64* mPtr = m->m.base;
-        f64* vPtr = v->v.base;
-
-        for( s32 i = 0; i < columnCount; ++i )
-            mPtr[ row + i ] = vPtr[ i ];
-    }
+        ASSERT( m->rowCount == m->columnCount );
+        ASSERT( m->rowCount == b->rowCount );
+        ASSERT( result->m.base != m->m.base );
 
-    void DeleteLastColumn( Mf64* m )
-    {
-        ASSERT( m->columnCount > 0 );
+        s32 size        = m->rowCount;
+        s32 columnCount = b->columnCount;
 
-        f64* mPtr       = m->m.base;
+        WORKSPACE_MEMORY();
 
-        s32 rowCount    = m->rowCount;
-        s32 columnCount = m->columnCount;
-        --m->columnCount;
+        Mf64 l          = CreateMf64( size, size, &workspace );
+        s32 lRowStride  = l.rowStride;
+        s32 mRowStride  = m->rowStride;
+        f64* lArrayPtr  = l.m.base;
+        f64* mArrayPtr  = m->m.base;
 
-        s32 offset = 1;
-        for( s32 i = 1; i < rowCount; ++i )
+        for( s32 i = 0; i < size; ++i )
         {
-            s32 row = i * columnCount;
-            for( s32 j = 0; j < columnCount - 1; ++j )
-                mPtr[ row + j - offset ] = mPtr[ row + j ];
-
-            ++offset;
+            for( s32 j = 0; j <= i; ++j )
+                lArrayPtr[ i * lRowStride + j ] = mArrayPtr[ i * mRowStride + j ];
         }
-    }
-
-    Mf64 MultiplyWithDiagonal( Mf64* m, Vf64* d )
-    {
-        ASSERT( m->columnCount == d->count );
-
-        s32 rowCount    = m->rowCount;
-        s32 columnCount = m->columnCount;
-        Mf64 result     = CreateMf64( rowCount, columnCount );
 
-        f64* rArrayPtr  = result.m.base;
-        f64* mArrayPtr  = m->m.base;
-        f64* dArrayPtr  = d->v.base;
+        f64* bArrayPtr  = b->m.base;
 
-        for( s32 i = 0; i < rowCount; ++i )
+        if( CholeskyFactor( &l ) )
         {
-            f64* rPtr = &rArrayPtr[ i * columnCount ];
-            f64* mPtr = &mArrayPtr[ i * columnCount ];
+            if( result->m.base != bArrayPtr )
+            {
+                Resize( result, size, columnCount );
+                for( s32 i = 0; i < size; ++i )
+                    memcpy( &result->m.base[ i * result->rowStride ], &bArrayPtr[ i * b->rowStride ], sizeof( f64 ) * columnCount );
+            }
 
-            for( s32 j = 0; j < columnCount; ++j )
-                rPtr[ j ] = mPtr[ j ] * dArrayPtr[ j ];
+            TriangularSolve( &l, 0, false, result );
         }
+        else
+        {
+            for( s32 i = 0; i < size; ++i )
+            {
+                for( s32 j = 0; j <= i; ++j )
+                    lArrayPtr[ i * lRowStride + j ] = mArrayPtr[ i * mRowStride + j ];
+            }
 
-        return result;
-    }
+            Vf64 d              = CreateVf64( size, &workspace );
+            s32* permutation    = workspace.Push< s32 >( size );
 
-    Mf64 MultiplyWithTranspose( Mf64* m, Mf64* t )
-    {
-        ASSERT( m->columnCount == t->columnCount );
+            LDLTFactor( &l, &d, permutation );
 
-        s32 mRowCount       = m->rowCount;
-        s32 mColumnCount    = m->columnCount;
-        s32 tRowCount       = t->rowCount;
-        s32 tColumnCount    = t->columnCount;
-        Mf64 result         = CreateMf64( mRowCount, tRowCount );
+            Mf64 permuted   = CreateMf64( size, columnCount, &workspace );
+            f64* pArrayPtr  = permuted.m.base;
 
-        f64* rArrayPtr      = result.m.base;
-        f64* mArrayPtr      = m->m.base;
-        f64* tArrayPtr      = t->m.base;
+            for( s32 i = 0; i < size; ++i )
+            {
+                f64* pPtr = &pArrayPtr[ i * permuted.rowStride ];
+                f64* bPtr = &bArrayPtr[ permutation[ i ] * b->rowStride ];
 
-        for( s32 i = 0; i < mRowCount; ++i )
-        {
-            f64* rPtr = &rArrayPtr[ i * tRowCount ];
-            f64* mPtr = &mArrayPtr[ i * mColumnCount ];
+                for( s32 j = 0; j < columnCount; ++j )
+                    pPtr[ j ] = bPtr[ j ];
+            }
 
-            for( s32 j = 0; j < tRowCount; ++j )
-            {
-                f64* tPtr = &tArrayPtr[ j * tColumnCount ];
+            TriangularSolve( &l, &d, true, &permuted );
 
-                f64 sum = 0;
-                for( s32 k = 0; k < tColumnCount; ++k )
-                    sum += mPtr[ k ] * tPtr[ k ];
+            Resize( result, size, columnCount );
+            f64* rArrayPtr = result->m.base;
 
-                rPtr[ j ] = sum;
+            for( s32 i = 0; i < size; ++i )
+            {
+                f64* rPtr = &rArrayPtr[ permutation[ i ] * result->rowStride ];
+                f64* pPtr = &pArrayPtr[ i * permuted.rowStride ];
+
+                for( s32 j = 0; j < columnCount; ++j )
+                    rPtr[ j ] = pPtr[ j ];
             }
         }
-
-        return result;
     }
 
-    Vf64 SumRows( Mf64* m )
+    void GetPrincipalComponents( Mf64* m, s32 count, Mf64* eigenVectors, Vf64* eigenValues, PrincipalComponentsMode mode )
     {
-        s32 rowCount    = m->rowCount;
         s32 columnCount = m->columnCount;
-        Vf64 result     = CreateVf64( rowCount );
 
-        f64* rArrayPtr  = result.v.base;
-        f64* mArrayPtr  = m->m.base;
+        ASSERT( count > 0 && count <= columnCount );
 
-        for( s32 i = 0; i < rowCount; ++i )
+        if( mode == PrincipalComponentsMode_Auto )
         {
-            f64* mPtr = &mArrayPtr[ i * columnCount ];
-
-            rArrayPtr[ i ] = 0;
-            for( s32 j = 0; j < columnCount; ++j )
-                rArrayPtr[ i ] += mPtr[ j ];
+            bool subspace   = columnCount >= PCA_SUBSPACE_MIN_DIMENSIONS && count + PCA_SUBSPACE_OVERSAMPLING < columnCount;
+            mode            = subspace ? PrincipalComponentsMode_Subspace : PrincipalComponentsMode_Jacobi;
         }
 
-        return result;
-    }
+        if( mode == PrincipalComponentsMode_Subspace )
+        {
+            GetLeadingEigenVectorsSubspace( m, count, eigenVectors, eigenValues );
+        }
+        else
+        {
+            Mf64 covariant = GetCovariance( m );
+            GetEigenVectorsAndValuesJacobi( &covariant, eigenVectors, eigenValues );
+            SortEigenVectorsAndValues( eigenVectors, eigenValues );
 
-    Mf64 GetTranspose( Mf64* m )
-    {
-        s32 rowCount    = m->rowCount;
-        s32 columnCount = m->columnCount;
-        Mf64 result     = CreateMf64( columnCount, rowCount );
-        f64* rPtr       = result.m.base;
-        f64* mPtr       = m->m.base;
+            while( eigenVectors->columnCount > count )
+                DeleteLastColumn( eigenVectors );
 
-        for( s32 i = 0; i < rowCount; ++i )
-        {
-            for( s32 j = 0; j < columnCount; ++j )
-                rPtr[ j * rowCount + i ] = mPtr[ i * columnCount + j ];
+            eigenValues->count = count;
         }
 
-        return result;
-    }
+        //an eigenvector's sign is arbitrary and each solver lands on its own, so every vector is turned to make its
+        //largest entry positive and both modes start the same training from the same data
+        s32 rowStride   = eigenVectors->rowStride;
+        f64* vectorPtr  = eigenVectors->m.base;
 
-    void ExpEquals( Mf64* m )
-    {
-        f64* mPtr = m->m.base;
+        for( s32 j = 0; j < count; ++j )
+        {
+            s32 largest = 0;
+            for( s32 i = 1; i < columnCount; ++i )
+            {
+                if( fabs( vectorPtr[ i * rowStride + j ] ) > fabs( vectorPtr[ largest * rowStride + j ] ) )
+                    largest = i;
+            }
 
-        s32 count = m->rowCount * m->columnCount;
-        for( s32 i = 0; i < count; ++i )
-            mPtr[ i ] = ::exp( mPtr[ i ] );
+            if( vectorPtr[ largest * rowStride + j ] < 0 )
+            {
+                for( s32 i = 0; i < columnCount; ++i )
+                    vectorPtr[ i * rowStride + j ] = -vectorPtr[ i * rowStride + j ];
+            }
+        }
     }
 
-    Vf64 GetMeanRows( Mf64* m )
+    void BuildKDTree( Mf64* points, KDTree* tree )
     {
-        s32 rowCount        = m->rowCount;
-        s32 columnCount     = m->columnCount;
-        f64 invColumnCount  = 1.0 / ( f64 ) columnCount;
+        s32 count       = points->rowCount;
 
-        Vf64 result         = CreateVf64( rowCount );
-        f64* rArrayPtr      = result.v.base;
-        f64* mArrayPtr      = m->m.base;
+        tree->points    = points;
+        tree->nodeCount = 0;
 
-        for( s32 i = 0; i < rowCount; ++i )
-        {
-            f64* mPtr = &mArrayPtr[ i * columnCount ];
+        //each split leaves at least KD_TREE_LEAF_SIZE / 2 points a side, so there are at most that many leaves
+        s32 nodeCount   = 2 * ( count / ( KD_TREE_LEAF_SIZE / 2 ) + 1 );
 
-            f64 sum = 0;
-            for( s32 j = 0; j < columnCount; ++j )
-                sum += mPtr[ j ];
+        if( tree->indices.count < count )
+            tree->indices = Array< s32 >( count );
 
-            sum *= invColumnCount;
+        if( tree->nodes.count < nodeCount )
+            tree->nodes = Array< KDTreeNode >( nodeCount, CACHE_LINE_SIZE );
 
-            rArrayPtr[ i ] = sum;
-        }
+        for( s32 i = 0; i < count; ++i )
+            tree->indices.base[ i ] = i;
 
-        return result;
+        if( count > 0 )
+            BuildKDTreeNode( tree, 0, count );
     }
 
-    Vf64 GetMeanColumns( Mf64* m )
+    s32 GetNearest( KDTree* tree, f64* query, s32 skip, f64* squaredDistance, bool padded )
     {
-        s32 rowCount    = m->rowCount;
-        s32 columnCount = m->columnCount;
-        f64 invRowCount = 1.0 / ( f64 ) rowCount;
-        Vf64 result     = CreateVf64( columnCount );
+        s32 best            = -1;
+        f64 bestDistance    = HUGE_VAL;
 
-        f64* rArrayPtr  = result.v.base;
-        f64* mArrayPtr  = m->m.base;
-        f64* mPtr       = mArrayPtr;
+        if( tree->nodeCount > 0 )
+            SearchKDTree( tree, 0, query, skip, padded, &best, &bestDistance );
 
-        for( s32 i = 0; i < columnCount; ++i )
-            rArrayPtr[ i ] = mPtr[ i ];
+        if( squaredDistance )
+            *squaredDistance = bestDistance;
 
-        for( s32 i = 1; i < rowCount - 1; ++i )
-        {
-            mPtr = &mArrayPtr[ i * columnCount ];
-            for( s32 j = 0; j < columnCount; ++j )
-                rArrayPtr[ j ] += mPtr[ j ];
-        }
+        return best;
+    }
 
-        mPtr = &mArrayPtr[ ( rowCount - 1 ) * columnCount ];
-        for( s32 i = 0; i < columnCount; ++i )
-        {
-            rArrayPtr[ i ] += mPtr[ i ];
-            rArrayPtr[ i ] *= invRowCount;
-        }
+    s32 GetWithin( KDTree* tree, f64* query, f64 squaredRadius, s32* indices, f64* squaredDistances, bool padded )
+    {
+        s32 result = 0;
+        if( tree->nodeCount > 0 )
+            result = SearchKDTreeWithin( tree, 0, query, squaredRadius, padded, indices, squaredDistances, 0 );
 
         return result;
     }
 
-    Vf64 GetMinColumns( Mf64* m )
+    void GetNearestSquaredDistances( KDTree* tree, Vf64* squaredDistances, s32* nearest )
     {
-        s32 rowCount    = m->rowCount;
-        s32 columnCount = m->columnCount;
-        Vf64 result     = CreateVf64( columnCount );
+        s32 count = tree->points->rowCount;
 
-        f64* rArrayPtr  = result.v.base;
-        f64* mArrayPtr  = m->m.base;
-        f64* mPtr       = mArrayPtr;
+        Resize( squaredDistances, count );
 
-        for( s32 i = 0; i < columnCount; ++i )
-            rArrayPtr[ i ] = mPtr[ i ];
+        NearestData data    = { tree, squaredDistances->v.base, nearest };
+        s32 grain           = Platform::GetGrain( ( s64 ) 4 * KD_TREE_LEAF_SIZE * tree->points->rowStride );
+        Platform::ParallelFor( count, grain, NearestRows, &data );
+    }
 
-        for( s32 i = 1; i < rowCount; ++i )
-        {
-            mPtr = &mArrayPtr[ i * columnCount ];
-            for( s32 j = 0; j < columnCount; ++j )
-                rArrayPtr[ j ] = fmin( rArrayPtr[ j ], mPtr[ j ] );
-        }
+    Vf64 GetSquaredRowNorms( Mf64* m )
+    {
+        return GetSquaredRowNorms( View( m ) );
+    }
 
+    Vf64 GetSquaredRowNorms( Mf64View m )
+    {
+        Vf64 result = CreateVf64( m.rowCount );
+        SquaredRowNorms( m, &result );
         return result;
     }
 
-    Mf64 Invert( Mf64* m )
+    Vf32 GetSquaredRowNorms( Mf32* m )
     {
-        ASSERT( m->rowCount == m->columnCount );
-
-        s32 size        = m->rowCount;
-        Mf64 result     = UnitMf64( size, size );
-
-        f64* rArrayPtr  = result.m.base;
-        f64* mArrayPtr  = m->m.base;
-        f64* rPtr0;
-        f64* rPtr1;
-        f64* mPtr0;
-        f64* mPtr1;
-
-        for( s32 i = 0; i < size; ++i )
-        {
-            s32 index = Pivot( m, i );
-
-            ASSERT( index >= 0 );
-
-            if( index > 0 )
-            {
-                rPtr0 = &rArrayPtr[ i * size ];
-                rPtr1 = &rArrayPtr[ index * size ];
-
-                for( s32 a = 0; a < size; ++a )
-                {
-                    f64 swap    = rPtr0[ a ];
-                    rPtr0[ a ]  = rPtr1[ a ];
-                    rPtr1[ a ]  = swap;
-                }
-            }
-
-            rPtr0 = &rArrayPtr[ i * size ];
-            mPtr0 = &mArrayPtr[ i * size ];
-
-            f64 a1 = 1 / mPtr0[ i ];
-            for( s32 j = 0; j < size; ++j )
-            {
-                mPtr0[ j ]  *= a1;
-                rPtr0[ j ]  *= a1;
-            }
-
-            for( s32 j = 0; j < size; ++j )
-            {
-                if( j != i )
-                {
-                    rPtr1 = &rArrayPtr[ j * size ];
-                    mPtr1 = &mArrayPtr[ j * size ];
-
-                    f64 a2 = mPtr1[ i ];
-                    for( s32 k = 0; k < size; ++k )
-                    {
-                        mPtr1[ k ]  -= a2 * mPtr0[ k ];
-                        rPtr1[ k ]  -= a2 * rPtr0[ k ];
-                    }
-                }
-            }
-        }
-
+        Vf32 result = CreateVf32( m->rowCount );
+        SquaredRowNorms( View( m ), &result );
         return result;
     }
 
-    void GetPrincipalComponents( Mf64* m, Mf64* eigenVectors, Vf64* eigenValues )
+    void GetSquaredRowNorms( Mf64* m, Vf64* result )
     {
-        Mf64 covariant = GetCovariant( m );
-        GetEigenVectorsAndValuesJacobi( &covariant, eigenVectors, eigenValues );
-        SortEigenVectorsAndValues( eigenVectors, eigenValues );
+        Resize( result, m->rowCount );
+        SquaredRowNorms( View( m ), result );
     }
 
-    void Distance( Mf64* m, Mf64* n, Mf64* result )
+    void GetSquaredRowNorms( Mf32* m, Vf32* result )
     {
-        s32 rColumnCount    = result->columnCount;
-        s32 mRowCount       = m->rowCount;
-        s32 mColumnCount    = m->columnCount;
-        s32 nRowCount       = n->rowCount;
-        s32 nColumnCount    = n->columnCount;
-
-        ASSERT( nRowCount <= result->rowCount );
-        ASSERT( mRowCount <= result->columnCount );
-
-        s32 iJumpCount      = F64_PER_CACHE_LINE * 32;
-        s32 jJumpStartCount = F64_PER_CACHE_LINE;
-        s32 blockJumpCount  = ( ( mRowCount - 1 ) / jJumpStartCount ) / Platform::GetProcessorCount() + 1;
-        blockJumpCount      = Utils::Max( blockJumpCount, jJumpStartCount );
-
-        s32 dataIndex   = 0;
-        s32 dataCount   = ( nRowCount - 1 ) / iJumpCount + 1;
-        dataCount       *= ( mRowCount - 1 ) / jJumpStartCount + 1;
-        DistanceBlockData* data = new DistanceBlockData[ dataCount ];
+        Resize( result, m->rowCount );
+        SquaredRowNorms( View( m ), result );
+    }
 
-        for( s32 i = 0; i < nRowCount; i += iJumpCount )
-        {
-            iJumpCount      = Utils::Min( iJumpCount, nRowCount - i );
-            s32 jJumpCount  = jJumpStartCount;
+    void Distance( Mf64* m, Mf64* n, Mf64* result, Vf64* mSquaredNorms, DistanceMode mode )
+    {
+        DistanceViews( View( m ), View( n ), result, mSquaredNorms, mode, true );
+    }
 
-            for( s32 j = 0; j < mRowCount; j += blockJumpCount )
-            {
-                data[ dataIndex ] = {};
-                data[ dataIndex ].startIndex    = j;
-                data[ dataIndex ].endIndexPlus1 = Utils::Min( j + blockJumpCount, mRowCount );
+    void Distance( Mf64View m, Mf64View n, Mf64* result, Vf64* mSquaredNorms, DistanceMode mode )
+    {
+        DistanceViews( m, n, result, mSquaredNorms, mode, false );
+    }
 
-                data[ dataIndex ].rColumnCount  = rColumnCount;
-                data[ dataIndex ].mColumnCount  = mColumnCount;
-                data[ dataIndex ].nColumnCount  = nColumnCount;
+    void ReserveWorkerBuffers()
+    {
+        CreateGemmPackBuffers();
+    }
 
-                data[ dataIndex ].iJumpCount    = iJumpCount;
-                data[ dataIndex ].jJumpCount    = jJumpCount;
+    s64 GetWorkspaceHighWaterMark()
+    {
+        return workspaceHighWaterMark.load( std::memory_order_relaxed );
+    }
 
-                data[ dataIndex ].indexR        = i * rColumnCount;
-                data[ dataIndex ].indexN        = i * nColumnCount;
+    void DistanceRange( s32 threadIndex, Mf64* m, s32 mStart, s32 mEndPlus1, Mf64* n, f64* result, s32 rColumnCount,
+                        Vf64* mSquaredNorms, Vf64* nSquaredNorms, DistanceMode mode )
+    {
+        DistanceRows( threadIndex, View( m ), mStart, mEndPlus1, View( n ), result, rColumnCount, mSquaredNorms, nSquaredNorms, mode, true );
+    }
 
-                data[ dataIndex ].result        = result;
-                data[ dataIndex ].m             = m;
-                data[ dataIndex ].n             = n;
-                Platform::AddWorkQueueEntry( Mf64DistanceBlock, &data[ dataIndex ] );
-                ++dataIndex;
-            }
-        }
+    void DistanceRange( s32 threadIndex, Mf32* m, s32 mStart, s32 mEndPlus1, Mf32* n, f32* result, s32 rColumnCount,
+                        Vf32* mSquaredNorms, Vf32* nSquaredNorms, DistanceMode mode )
+    {
+        DistanceRows( threadIndex, View( m ), mStart, mEndPlus1, View( n ), result, rColumnCount, mSquaredNorms, nSquaredNorms, mode, true );
+    }
 
-        Platform::FinishWork();
+    void MultiplyAccumulateRange( s32 threadIndex, Mf64View m, Mf64View n, Mf64* result )
+    {
+        MultiplyAccumulateRows( threadIndex, m, n, result );
+    }
 
-        delete [] data;
+    void MultiplyAccumulateRange( s32 threadIndex, Mf32View m, Mf32View n, Mf32* result )
+    {
+        MultiplyAccumulateRows( threadIndex, m, n, result );
     }
 
     void Grid( Mf64* m, s32* count )
@@ -957,13 +3974,11 @@ namespace XMaths
         for( s32 i = 0; i < m->columnCount; ++i )
             index[ i ] = 0;
 
-        s32 gridIndex = 0;
-
         for( s32 i = 0; i < m->rowCount * m->columnCount; ++i )
         {
             s32 currDim = i % m->columnCount;
             f64 dist = 2.0 / ( ( f64 ) count[ currDim ] - 1.0 );
-            mPtr[ gridIndex++ ] = -1.0 + dist * index[ currDim ];
+            mPtr[ ( i / m->columnCount ) * m->rowStride + currDim ] = -1.0 + dist * index[ currDim ];
 
             if( currDim == 0 )
             {
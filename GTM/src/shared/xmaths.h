@@ -11,35 +11,135 @@ namespace XMaths
     s32 ArrayProduct( s32* array, s32 count );
 
 
-    struct Vf64
+    //vectorised with AVX2 when the build targets it and a scalar path with the same bits otherwise,
+    //exp is within 1 ulp and log within 2 ulp of a long double reference; result can be the same array as values
+    void Exp( f64* values, f64* result, s32 count, f64 scale = 1.0 );
+    void Log( f64* values, f64* result, s32 count );
+    f64 SumLog( f64* values, s32 count );
+    //the f32 exp is within 2 ulp, SumLog widens to f64 first and adds up in f64
+    void Exp( f32* values, f32* result, s32 count, f32 scale = 1.0f );
+    f64 SumLog( f32* values, s32 count );
+
+
+    template< typename T >
+    struct Vector
     {
         s32 count;
-        Array< f64 > v;
+        Array< T > v;
     };
 
+    typedef Vector< f64 > Vf64;
+    typedef Vector< f32 > Vf32;
+
 
     Vf64 CreateVf64( s32 count );
+    //from arena, and only valid until it is reset or popped past this
+    Vf64 CreateVf64( s32 count, Arena* arena );
+    Vf32 CreateVf32( s32 count );
 
     void SqrtEquals( Vf64* v );
 
     f64 GetMean( Vf64* v );
 
 
-    struct Mf64
+    //rows are padded out to a whole number of MATRIX_ROW_ALIGNMENT bytes, the AVX2 width, so every row starts vector
+    //aligned and a kernel can run whole vectors along it; element ( i, j ) is m[ i * rowStride + j ] and the padding
+    //is zero, and everything that writes a matrix leaves it so
+    const s32 MATRIX_ROW_ALIGNMENT = 32;
+
+    template< typename T >
+    s32 GetRowStride( s32 columnCount )
+    {
+        const s32 elementCount = MATRIX_ROW_ALIGNMENT / sizeof( T );
+        return ( ( columnCount + elementCount - 1 ) / elementCount ) * elementCount;
+    }
+
+    template< typename T >
+    struct Matrix
     {
         s32 rowCount;
         s32 columnCount;
-        Array< f64 > m;
+        s32 rowStride;
+        Array< T > m;
 
-        void operator += ( const Mf64 &n );
+        void operator += ( const Matrix &n );
 
-        Mf64 operator * ( const Mf64 &n );
-        Mf64 operator * ( f64 s );
-        void operator *= ( f64 s );
+        Matrix operator * ( const Matrix &n );
+        Matrix operator * ( T s );
+        void operator *= ( T s );
     };
 
+    typedef Matrix< f64 > Mf64;
+    typedef Matrix< f32 > Mf32;
+
+    //the matrix algebra is f64 only, f32 matrices have the conversion and the kernels the e step needs
+    template<> void Mf64::operator += ( const Mf64 &n );
+    template<> Mf64 Mf64::operator * ( const Mf64 &n );
+    template<> Mf64 Mf64::operator * ( f64 s );
+    template<> void Mf64::operator *= ( f64 s );
+
+
+    //some rows and columns of a matrix, or its transpose, read in place without owning or copying anything:
+    //element ( i, j ) is base[ i * rowStride + j ], or base[ j * rowStride + i ] when transposed
+    template< typename T >
+    struct MatrixView
+    {
+        T* base;
+        s32 rowCount;
+        s32 columnCount;
+        s32 rowStride;
+        bool transposed;
+    };
+
+    typedef MatrixView< f64 > Mf64View;
+    typedef MatrixView< f32 > Mf32View;
+
+    template< typename T >
+    MatrixView< T > View( Matrix< T >* m )
+    {
+        MatrixView< T > result = { m->m.base, m->rowCount, m->columnCount, m->rowStride, false };
+        return result;
+    }
+
+    //rows [ rowStart, rowStart + rowCount ) and columns [ columnStart, columnStart + columnCount ) of v
+    template< typename T >
+    MatrixView< T > View( MatrixView< T > v, s32 rowStart, s32 rowCount, s32 columnStart, s32 columnCount )
+    {
+        ASSERT( rowStart >= 0 && rowCount >= 0 && rowStart + rowCount <= v.rowCount );
+        ASSERT( columnStart >= 0 && columnCount >= 0 && columnStart + columnCount <= v.columnCount );
+
+        s32 offset              = v.transposed ? columnStart * v.rowStride + rowStart : rowStart * v.rowStride + columnStart;
+        MatrixView< T > result  = { v.base + offset, rowCount, columnCount, v.rowStride, v.transposed };
+        return result;
+    }
 
+    template< typename T >
+    MatrixView< T > View( Matrix< T >* m, s32 rowStart, s32 rowCount, s32 columnStart, s32 columnCount )
+    {
+        return View( View( m ), rowStart, rowCount, columnStart, columnCount );
+    }
+
+    template< typename T >
+    MatrixView< T > TransposedView( MatrixView< T > v )
+    {
+        MatrixView< T > result = { v.base, v.columnCount, v.rowCount, v.rowStride, !v.transposed };
+        return result;
+    }
+
+
+    //the contents are not set but the padding is zeroed
     Mf64 CreateMf64( s32 rows, s32 columns );
+    Mf64 CreateMf64( s32 rows, s32 columns, Arena* arena );
+    Mf32 CreateMf32( s32 rows, s32 columns );
+    //result = m - offset with offset[ j ] taken off column j, offset can be NULL; result must already be m's size,
+    //its rows are written through ParallelFor, so on several NUMA nodes they first touch the nodes that run them
+    void Convert( Mf64* m, Vf64* offset, Mf32* result );
+    void Convert( Mf64* m, Vf64* offset, Mf64* result );
+    //sets the size, only allocating when the array is too small, so storage reused at one size never allocates;
+    //the contents are not kept and the padding is zeroed when the shape changes
+    void Resize( Mf64* m, s32 rows, s32 columns );
+    void Resize( Vf64* v, s32 count );
+    void Resize( Vf32* v, s32 count );
     Mf64 ZeroMf64( s32 rows, s32 columns );
     Mf64 UnitMf64( s32 rows, s32 columns );
 
@@ -47,10 +147,57 @@ namespace XMaths
 
     void DeleteLastColumn( Mf64* m );
 
+    //lazy matrix algebra: Transposed, Diagonal and the operators below only record what to compute and Evaluate
+    //writes it into a matrix the caller owns, resized as above; a product runs as one gemm that reads transposes
+    //and views in place and applies the diagonal and scalar factors while packing the left operand, so
+    //Evaluate( &A, Transposed( &FI ) * Diagonal( &g ) * FI ) needs neither FI^T nor FI^T * diag( g ) stored
+    struct MatrixExpression
+    {
+        //scale * m * diag( diagonal ), diagonal can be NULL
+        Mf64View m;
+        Vf64* diagonal;
+        f64 scale;
+    };
+
+    struct DiagonalExpression
+    {
+        Vf64* d;
+    };
+
+    //only the left factor of a product can carry a diagonal
+    struct ProductExpression
+    {
+        MatrixExpression a;
+        MatrixExpression b;
+    };
+
+    MatrixExpression Lazy( Mf64* m );
+    MatrixExpression Lazy( Mf64View m );
+    MatrixExpression Transposed( Mf64* m );
+    MatrixExpression Transposed( Mf64View m );
+    DiagonalExpression Diagonal( Vf64* d );
+
+    MatrixExpression operator * ( MatrixExpression e, DiagonalExpression d );
+    MatrixExpression operator * ( Mf64 &m, DiagonalExpression d );
+    MatrixExpression operator * ( f64 s, MatrixExpression e );
+    ProductExpression operator * ( MatrixExpression a, MatrixExpression b );
+    ProductExpression operator * ( MatrixExpression a, Mf64 &b );
+    ProductExpression operator * ( Mf64 &a, MatrixExpression b );
+    ProductExpression operator * ( f64 s, ProductExpression p );
+
+    //result must not share storage with an operand
+    void Evaluate( Mf64* result, MatrixExpression e );
+    void Evaluate( Mf64* result, ProductExpression p );
+
+    //result = m^T * diag( weights ) * m, weights can be NULL, resized as Evaluate does; being symmetric only its lower
+    //triangle is computed, which is all SolveSymmetric reads, and entries above it are not defined
+    void WeightedGram( Mf64* m, Vf64* weights, Mf64* result );
+
     Mf64 MultiplyWithDiagonal( Mf64* m, Vf64* d );
     Mf64 MultiplyWithTranspose( Mf64* m, Mf64* t );
 
     Vf64 SumRows( Mf64* m );
+    Vf64 SumRows( Mf64View m );
 
     Mf64 GetTranspose( Mf64* m );
 
@@ -58,14 +205,152 @@ namespace XMaths
 
     Vf64 GetMeanRows( Mf64* m );
     Vf64 GetMeanColumns( Mf64* m );
+    Vf64 GetMeanColumns( Mf64View m );
+
+    //mean and scatter, the sum of ( x - mean ) * ( x - mean )^T, of every row added so far, so the means and the
+    //covariance can come from one pass over data read a block at a time and never held whole; each block is centred
+    //on its own mean, its scatter taken on the gemm and merged in with chan's update, which stays accurate however
+    //far from the origin the data sits; only the lower triangle of scatter is kept
+    struct CovarianceAccumulator
+    {
+        s64 count;
+        Vf64 mean;
+        Mf64 scatter;
+    };
+
+    CovarianceAccumulator CreateCovarianceAccumulator( s32 columns );
+    //rows cannot be transposed
+    void AddRows( CovarianceAccumulator* accumulator, Mf64View rows );
+    //the sample covariance, scatter / ( count - 1 ) with both triangles filled in
+    Mf64 GetCovariance( CovarianceAccumulator* accumulator );
+    //of m's rows, added to an accumulator a few megabytes at a time
+    Mf64 GetCovariance( Mf64* m );
 
     Vf64 GetMinColumns( Mf64* m );
 
+    //P * m = L * U with partial pivoting, L unit lower triangular and U upper triangular sharing lu, row i having
+    //been swapped with row pivots[ i ] as it went; norm is m's 1-norm, for the condition estimate
+    struct LUFactors
+    {
+        Mf64 lu;
+        Array< s32 > pivots;
+        f64 norm;
+        bool singular;
+    };
+
+    //blocked, with the trailing updates run as gemms on the work queue, reusing factors' storage so factoring one size
+    //again does not allocate; returns false and sets singular when a column has no pivot, which is then skipped
+    bool LUFactor( Mf64* m, LUFactors* factors );
+    //solves m * x = b for the m factored, b can hold several right hand sides as columns and result can be b
+    void SolveLU( LUFactors* factors, Mf64* b, Mf64* result );
+    //estimate of m's 1-norm condition number |m| |m^-1|, a lower bound that is nearly always within a factor of 3,
+    //from a few single vector solves; HUGE_VAL when singular
+    f64 GetConditionEstimate( LUFactors* factors );
+
+    //through LUFactor, leaving m as it was
     Mf64 Invert( Mf64* m );
+    //solves m * x = b for symmetric positive definite m, b can hold several right hand sides as columns,
+    //only the lower triangle of m is read; uses a blocked cholesky and falls back to a pivoted LDL^T
+    //when m is only semi definite, in which case directions with a zero pivot are left out of x
+    Mf64 SolveSymmetric( Mf64* m, Mf64* b );
+    //as above into result, resized as needed, with the factor kept between calls so solves of one size do not allocate
+    void SolveSymmetric( Mf64* m, Mf64* b, Mf64* result );
+
+    //the leading count principal components of the rows of m, the eigenvectors of their covariance with the largest
+    //eigenvalues, as the columns of eigenVectors with the eigenvalues largest first; Jacobi forms the covariance and
+    //finds every eigenpair, Subspace runs block power iteration with a rayleigh ritz step straight from m, two gemms
+    //over m each iteration and nothing D x D, and Auto picks it from PCA_SUBSPACE_MIN_DIMENSIONS columns
+    enum PrincipalComponentsMode
+    {
+        PrincipalComponentsMode_Auto = 0,
+        PrincipalComponentsMode_Jacobi,
+        PrincipalComponentsMode_Subspace
+    };
+
+    const s32 PCA_SUBSPACE_MIN_DIMENSIONS = 128;
+
+    void GetPrincipalComponents( Mf64* m, s32 count, Mf64* eigenVectors, Vf64* eigenValues,
+                                 PrincipalComponentsMode mode = PrincipalComponentsMode_Auto );
+
+    //k-d tree over the rows of a matrix for exact nearest neighbour queries, split at the median of the widest
+    //dimension until a node holds at most KD_TREE_LEAF_SIZE points; it refers to points and reorders only its own
+    //indices, so points must stay as they are while the tree is used
+    const s32 KD_TREE_LEAF_SIZE = 8;
+
+    struct KDTreeNode
+    {
+        //-1 for a leaf, whose points are indices[ start, start + count )
+        s32 splitDimension;
+        f64 splitValue;
+
+        s32 start;
+        s32 count;
+
+        //the left child is the next node
+        s32 right;
+    };
+
+    struct KDTree
+    {
+        Mf64* points;
+
+        Array< s32 > indices;
+        Array< KDTreeNode > nodes;
+        s32 nodeCount;
+    };
+
+    //O( K log K ), reusing tree's storage when it is big enough
+    void BuildKDTree( Mf64* points, KDTree* tree );
+    //index of the point nearest query, point skip left out so a point of the tree can find its nearest other one,
+    //and its squared distance when squaredDistance is set; -1 and HUGE_VAL when there is none; padded when query
+    //is a row of a matrix with the points' row stride, which compares whole vectors across the zero padding
+    s32 GetNearest( KDTree* tree, f64* query, s32 skip, f64* squaredDistance = 0, bool padded = false );
+    //every point within squaredRadius of query written to indices and their squared distances to squaredDistances,
+    //both with room for every point of the tree, in the order the tree holds them; returns how many there are
+    s32 GetWithin( KDTree* tree, f64* query, f64 squaredRadius, s32* indices, f64* squaredDistances, bool padded = false );
+    //the squared distance from every point of the tree to its nearest other point, and its index when nearest is set,
+    //queried in parallel; squaredDistances is resized as needed
+    void GetNearestSquaredDistances( KDTree* tree, Vf64* squaredDistances, s32* nearest = 0 );
+
+
+    //squared distance between every row of n and every row of m, result[ i ][ j ] = |n[ i ] - m[ j ]|^2
+    //Direct sums the differences, Gemm expands to |n|^2 + |m|^2 - 2 * n * m^T so the cross term runs on
+    //the gemm kernel and clamps the small negatives cancellation can leave, Auto picks Gemm once rows have
+    //DISTANCE_GEMM_MIN_DIMENSIONS columns; mSquaredNorms can pass in GetSquaredRowNorms( m ) when m is reused
+    enum DistanceMode
+    {
+        DistanceMode_Auto = 0,
+        DistanceMode_Direct,
+        DistanceMode_Gemm
+    };
+
+    const s32 DISTANCE_GEMM_MIN_DIMENSIONS = 8;
+
+    Vf64 GetSquaredRowNorms( Mf64* m );
+    Vf64 GetSquaredRowNorms( Mf64View m );
+    Vf32 GetSquaredRowNorms( Mf32* m );
+    void GetSquaredRowNorms( Mf64* m, Vf64* result );
+    void GetSquaredRowNorms( Mf32* m, Vf32* result );
 
-    void GetPrincipalComponents( Mf64* m, Mf64* eigenVectors, Vf64* eigenValues );
+    void Distance( Mf64* m, Mf64* n, Mf64* result, Vf64* mSquaredNorms = 0, DistanceMode mode = DistanceMode_Auto );
+    //as above between the rows of two views, which Direct needs untransposed
+    void Distance( Mf64View m, Mf64View n, Mf64* result, Vf64* mSquaredNorms = 0, DistanceMode mode = DistanceMode_Auto );
 
-    void Distance( Mf64* m, Mf64* n, Mf64* result );
+    //allocates the per thread buffers DistanceRange packs into, call from the main thread before queueing it
+    void ReserveWorkerBuffers();
+    //most bytes one thread's temporary workspace behind the queued kernels and the solvers has held at once
+    s64 GetWorkspaceHighWaterMark();
+    //Distance for rows [ mStart, mEndPlus1 ) of m only, run serially by the calling thread so it can be used inside a
+    //work queue entry, result[ i ][ j - mStart ] with a row stride of rColumnCount; Gemm needs both sets of norms,
+    //Direct sums whole vectors across the zero padding of m and n
+    void DistanceRange( s32 threadIndex, Mf64* m, s32 mStart, s32 mEndPlus1, Mf64* n, f64* result, s32 rColumnCount,
+                        Vf64* mSquaredNorms, Vf64* nSquaredNorms, DistanceMode mode = DistanceMode_Auto );
+    void DistanceRange( s32 threadIndex, Mf32* m, s32 mStart, s32 mEndPlus1, Mf32* n, f32* result, s32 rColumnCount,
+                        Vf32* mSquaredNorms, Vf32* nSquaredNorms, DistanceMode mode = DistanceMode_Auto );
+    //result += m * n, run serially by the calling thread like DistanceRange, for building up a product one tile at a
+    //time from views of the tile's columns and the matching rows of n
+    void MultiplyAccumulateRange( s32 threadIndex, Mf64View m, Mf64View n, Mf64* result );
+    void MultiplyAccumulateRange( s32 threadIndex, Mf32View m, Mf32View n, Mf32* result );
 
     void Grid( Mf64* m, s32* count );
 }
@@ -1,6 +1,7 @@
 #include "../shared/app.h"
 #include "../shared/platform.h"
 #include "../shared/types.h"
+#define UTILS_FUNCTIONS
 #include "../shared/utils.h"
 
 #include <stdio.h>
@@ -389,9 +390,39 @@ namespace
     au32 workQueueEntryWriteIndex       = 0;
 
     HANDLE hSemaphore;
+    s32 threadCount;
     ThreadInfo* threadInfo;
 
 
+    struct ParallelJob
+    {
+        s32 startIndex;
+        s32 endIndexPlus1;
+
+        //one of the two is set
+        Platform::ParallelForCallback* callback;
+        Platform::ParallelReduceCallback* reduceCallback;
+        void* data;
+
+        f64 result;
+    };
+
+    //stays below the size of the queue
+    const s32 MAX_PARALLEL_JOB_COUNT = 128;
+
+
+    const s32 MAX_TASK_COUNT = 64;
+
+    struct Task
+    {
+        Platform::WorkCallback* callback;
+        void* data;
+    };
+
+    Task tasks[ MAX_TASK_COUNT ];
+    s32 taskCount = 0;
+
+
     bool DoWork( ThreadInfo* info )
     {
         bool result = false;
@@ -424,6 +455,63 @@ namespace
                 WaitForSingleObjectEx( hSemaphore, INFINITE, false );
         };
     }
+
+
+    void RunParallelJob( s32 threadIndex, void* data )
+    {
+        ParallelJob* job = ( ParallelJob* ) data;
+
+        if( job->reduceCallback )
+            job->result = job->reduceCallback( threadIndex, job->startIndex, job->endIndexPlus1, job->data );
+        else
+            job->callback( threadIndex, job->startIndex, job->endIndexPlus1, job->data );
+    }
+
+    s32 SplitParallelJobs( s32 count, s32 grain, ParallelJob* jobs )
+    {
+        if( grain <= 0 )
+            grain = Platform::GetGrain( 1 );
+
+        s64 jobCount        = ( ( s64 ) count + grain - 1 ) / grain;
+        s32 maxJobCount     = Utils::Min( threadCount * Platform::PARALLEL_JOBS_PER_THREAD, MAX_PARALLEL_JOB_COUNT );
+        jobCount            = jobCount < maxJobCount ? jobCount : maxJobCount;
+
+        for( s32 i = 0; i < jobCount; ++i )
+        {
+            jobs[ i ]                   = {};
+            jobs[ i ].startIndex        = ( s32 ) ( count * i / jobCount );
+            jobs[ i ].endIndexPlus1     = ( s32 ) ( count * ( i + 1 ) / jobCount );
+        }
+
+        return ( s32 ) jobCount;
+    }
+
+    //queues every job but the first, releases the semaphore once for all of them and runs the first here
+    void RunParallelJobs( ParallelJob* jobs, s32 jobCount )
+    {
+        ASSERT( GetCurrentThreadId() == threadInfo[ 0 ].threadId );
+
+        if( jobCount > 1 )
+        {
+            Platform::FinishWork();
+
+            for( s32 i = 1; i < jobCount; ++i )
+            {
+                WorkQueueEntry* entry = &workQueueEntry[ workQueueEntryWriteIndex ];
+                entry->callback = RunParallelJob;
+                entry->data = &jobs[ i ];
+
+                ++workQueueEntryStartedCount;
+                atomic_store( &workQueueEntryWriteIndex, ( workQueueEntryWriteIndex + 1 ) & QUEUE_ENTRY_MASK );
+            }
+
+            ReleaseSemaphore( hSemaphore, Utils::Min( jobCount - 1, threadCount ), 0 );
+        }
+
+        RunParallelJob( 0, &jobs[ 0 ] );
+
+        Platform::FinishWork();
+    }
 }
 
 
@@ -464,6 +552,16 @@ namespace Platform
         return result;
     }
 
+    //the pool is not pinned, so every thread counts as on one node and memory is left to the system
+    s32 GetNodeCount()
+    {
+        return 1;
+    }
+
+    void PlaceMemory( void* memory, s64 size )
+    {
+    }
+
     void FinishWork()
     {
         ASSERT( GetCurrentThreadId() == threadInfo[ 0 ].threadId );
@@ -495,6 +593,63 @@ namespace Platform
 
         ReleaseSemaphore( hSemaphore, 1, 0 );
     }
+
+    //only the main thread can queue work here, so the tasks run one after another in the order they were added,
+    //which has every task after its dependencies, and each keeps whatever parallelism it has inside
+    TaskHandle AddTask( WorkCallback* callback, void* data, TaskHandle* dependencies, s32 dependencyCount )
+    {
+        ASSERT( taskCount < MAX_TASK_COUNT );
+
+        TaskHandle result = taskCount++;
+        tasks[ result ].callback    = callback;
+        tasks[ result ].data        = data;
+
+        return result;
+    }
+
+    void RunTasks()
+    {
+        for( s32 i = 0; i < taskCount; ++i )
+            tasks[ i ].callback( 0, tasks[ i ].data );
+
+        taskCount = 0;
+    }
+
+    void ParallelFor( s32 count, s32 grain, ParallelForCallback* callback, void* data )
+    {
+        ParallelJob jobs[ MAX_PARALLEL_JOB_COUNT ];
+        s32 jobCount = SplitParallelJobs( count, grain, jobs );
+
+        for( s32 i = 0; i < jobCount; ++i )
+        {
+            jobs[ i ].callback  = callback;
+            jobs[ i ].data      = data;
+        }
+
+        if( jobCount > 0 )
+            RunParallelJobs( jobs, jobCount );
+    }
+
+    f64 ParallelReduce( s32 count, s32 grain, ParallelReduceCallback* callback, void* data )
+    {
+        ParallelJob jobs[ MAX_PARALLEL_JOB_COUNT ];
+        s32 jobCount = SplitParallelJobs( count, grain, jobs );
+
+        for( s32 i = 0; i < jobCount; ++i )
+        {
+            jobs[ i ].reduceCallback    = callback;
+            jobs[ i ].data              = data;
+        }
+
+        if( jobCount > 0 )
+            RunParallelJobs( jobs, jobCount );
+
+        f64 result = 0;
+        for( s32 i = 0; i < jobCount; ++i )
+            result += jobs[ i ].result;
+
+        return result;
+    }
 }
 
 
@@ -510,7 +665,7 @@ s32 WINAPI WinMain( HINSTANCE hInstance,
 
     ASSERT( Utils::IsPowerOf2( ARRAY_COUNT( workQueueEntry ) ) );
 
-    s32 threadCount             = Platform::GetProcessorCount();
+    threadCount                 = Platform::GetProcessorCount();
     threadInfo                  = new ThreadInfo[ threadCount ];
     threadInfo[ 0 ].threadIndex = 0;
     threadInfo[ 0 ].threadId    = GetCurrentThreadId();